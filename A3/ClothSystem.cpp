@@ -1,40 +1,81 @@
 #include "ClothSystem.h"
-#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+	// m_gridEdges bits, the edge from grid index i * side + j to the particle one row
+	// (i + 1), one column (j + 1) or one of each further, or the row below and column before.
+	enum : uint8_t
+	{
+		kNextColumn = 1,
+		kNextRow = 2,
+		kDiagonal = 4,
+		kAntiDiagonal = 8
+	};
+
+	/**
+	 * @brief removes items[index] from the back to back ranges, which cover items,
+	 * the way ClothSystem::removeSpring describes.
+	 * @return the position of the range that held index.
+	 */
+	template <typename T>
+	int swapRemove(vector<T> &items, const vector<SpringRange *> &ranges, int index)
+	{
+		int owner = 0;
+		while (ranges[owner]->end <= index)
+			++owner;
+		int hole = index;
+		for (size_t i = owner; i < ranges.size(); ++i)
+		{
+			SpringRange &r = *ranges[i];
+			if (r.end > r.start)
+			{
+				items[hole] = items[r.end - 1];
+				hole = r.end - 1;
+			}
+			if (int(i) > owner)
+				--r.start;
+			--r.end;
+		}
+		items.pop_back();
+		return owner;
+	}
+}
 
 ClothSystem::ClothSystem(unsigned numParticlesPerSide) : ParticleSpringSystem(numParticlesPerSide * numParticlesPerSide)
 {
 	m_numParticlesPerSide = numParticlesPerSide;
+	m_vVecState.resize(m_numParticles); // all at rest.
 	// setup particles. I know isn't the best to go from top to down,
 	// but this way top corners are just in the first row so deal w it.
 	for (int j = 0; j < m_numParticlesPerSide; ++j)
 	{
 		for (int i = 0; i < m_numParticlesPerSide; ++i)
-		{
-			m_vVecState.push_back(Vector3f((float)i, (float)j, 0));
-			m_vVecState.push_back(Vector3f(0, 0, 0));
-		}
+			m_vVecState.setPosition(j * m_numParticlesPerSide + i, Vector3f((float)i, (float)j, 0));
 	}
 	setupBasicSprings();
 }
 
-Vector3f ClothSystem::getPosition(int i, int j, const vector<Vector3f> &state)
+Vector3f ClothSystem::getPosition(int i, int j, const ParticleState &state)
 {
-	return ParticleSpringSystem::getPosition(i * m_numParticlesPerSide + j, state);
+	return ParticleSpringSystem::getPosition(particleIndex(i * m_numParticlesPerSide + j), state);
 }
 
-Vector3f ClothSystem::getVelocity(int i, int j, const vector<Vector3f> &state)
+Vector3f ClothSystem::getVelocity(int i, int j, const ParticleState &state)
 {
-	return ParticleSpringSystem::getVelocity(i * m_numParticlesPerSide + j, state);
+	return ParticleSpringSystem::getVelocity(particleIndex(i * m_numParticlesPerSide + j), state);
 }
 
 Vector3f ClothSystem::getPosition(int i, int j)
 {
-	return ParticleSpringSystem::getPosition(i * m_numParticlesPerSide + j);
+	return ParticleSpringSystem::getPosition(particleIndex(i * m_numParticlesPerSide + j));
 }
 
 Vector3f ClothSystem::getVelocity(int i, int j)
 {
-	return ParticleSpringSystem::getVelocity(i * m_numParticlesPerSide + j);
+	return ParticleSpringSystem::getVelocity(particleIndex(i * m_numParticlesPerSide + j));
 }
 
 void ClothSystem::setupBasicSprings()
@@ -68,7 +109,11 @@ void ClothSystem::setupBasicSprings()
 			addSpringsAroundParticle(flexSpringDir, i, j);
 	flexSpringsRange.end = springs.size();
 
-	cout << "total num of springs: " << springs.size() << endl;
+	// split every range into classes that can be summed up in parallel.
+	structuralSpringColors = colorSprings(structuralSpringsRange);
+	shearSpringColors = colorSprings(shearSpringsRange);
+	flexSpringColors = colorSprings(flexSpringsRange);
+	notifySpringsChanged();
 }
 void ClothSystem::addSpringsAroundParticle(std::vector<Dir> &SpringDirs, int i, int j)
 {
@@ -86,30 +131,66 @@ void ClothSystem::addSpringsAroundParticle(std::vector<Dir> &SpringDirs, int i,
 	}
 }
 
-vector<Vector3f> ClothSystem::evalF(vector<Vector3f> state)
+void ClothSystem::evalF(const ParticleState &state, ParticleState &newState)
 {
-	vector<Vector3f> f;
+	// the derivative of the positions is the velocity. the forces are
+	// accumulated in the velocity slots and divided by the mass at the end.
+	const float *vx = state.vx(), *vy = state.vy(), *vz = state.vz();
+	float *dpx = newState.px(), *dpy = newState.py(), *dpz = newState.pz();
+	float *fx = newState.vx(), *fy = newState.vy(), *fz = newState.vz();
 	for (int i = 0; i < m_numParticles; ++i)
 	{
-		// gravity
-		f.push_back(Vector3f(0, -particleMass * g, 0)); // positively down maaannn.
-		// drag
-		Vector3f v = getVelocity(i, state);
-		f.at(i) -= drag * v; // already a vector so we're good.
+		dpx[i] = vx[i];
+		dpy[i] = vy[i];
+		dpz[i] = vz[i];
+		// gravity (positively down maaannn) and drag.
+		fx[i] = -drag * vx[i];
+		fy[i] = -particleMass * g - drag * vy[i];
+		fz[i] = -drag * vz[i];
 	}
 	// passing over springs and filling in the forces.
-	if (toggleStructure)
-		addSpringForces(f, structuralSpringsRange, state);
-	if (toggleShear)
-		addSpringForces(f, shearSpringsRange, state);
-	if (toggleFlex)
-		addSpringForces(f, flexSpringsRange, state);
-	vector<Vector3f> newState;
+	const bool sleeping = toggleSleeping && !sleepTiles.empty();
+	if (useGridStencil && m_hasGridStencil)
+		addGridSpringForces(newState, state);
+	else if (sleeping)
+	{
+		if (m_awakeSpringsGeneration != sleepTiles.generation())
+			updateAwakeSprings();
+		const bool active[3] = {toggleStructure, toggleShear, toggleFlex};
+		for (int kind = 0; kind < 3; ++kind)
+			if (active[kind])
+				addSpringForces(newState, m_awakeSprings.data(), m_awakeSpringColors[kind], state);
+	}
+	else
+	{
+		if (toggleStructure)
+			addSpringForces(newState, springs.data(), structuralSpringColors, state);
+		if (toggleShear)
+			addSpringForces(newState, springs.data(), shearSpringColors, state);
+		if (toggleFlex)
+			addSpringForces(newState, springs.data(), flexSpringColors, state);
+	}
 
-	for (int i = 0; i < m_numParticles; ++i)
+	const float invMass = 1.f / particleMass;
+	if (sleeping)
 	{
-		newState.push_back(getVelocity(i, state));
-		newState.push_back(f.at(i) / particleMass);
+		// sleeping particles are at rest (v = 0) and stay there.
+		const float *awake = sleepTiles.awakeMask().data();
+		for (int i = 0; i < m_numParticles; ++i)
+		{
+			fx[i] *= invMass * awake[i];
+			fy[i] *= invMass * awake[i];
+			fz[i] *= invMass * awake[i];
+		}
+	}
+	else
+	{
+		for (int i = 0; i < m_numParticles; ++i)
+		{
+			fx[i] *= invMass;
+			fy[i] *= invMass;
+			fz[i] *= invMass;
+		}
 	}
 	if (toggleMoveAnchors)
 		moveAnchorsLineMotion(newState);
@@ -117,49 +198,702 @@ vector<Vector3f> ClothSystem::evalF(vector<Vector3f> state)
 	{
 		// top corner particles are stationary
 		// top right corner
-		newState.at(newState.size() - 1) = 0;
-		newState.at(newState.size() - 2) = 0;
+		newState.setPosition(topRightCorner(), Vector3f::ZERO);
+		newState.setVelocity(topRightCorner(), Vector3f::ZERO);
 		// top left corner
-		newState.at(newState.size() - 2 * m_numParticlesPerSide) = 0;
-		newState.at(newState.size() - 2 * m_numParticlesPerSide + 1) = 0;
+		newState.setPosition(topLeftCorner(), Vector3f::ZERO);
+		newState.setVelocity(topLeftCorner(), Vector3f::ZERO);
 	}
-	return newState;
 }
 
-void ClothSystem::addSpringForces(std::vector<Vector3f> &f, const SpringRange &sr, const vector<Vector3f> &state)
+void ClothSystem::getActiveSpringRanges(vector<SpringRange> &ranges) const
 {
-	for (int i = sr.start; i < sr.end; ++i)
+	ranges.clear();
+	if (toggleStructure)
+		ranges.push_back(structuralSpringsRange);
+	if (toggleShear)
+		ranges.push_back(shearSpringsRange);
+	if (toggleFlex)
+		ranges.push_back(flexSpringsRange);
+}
+
+void ClothSystem::getSortableSpringRanges(vector<SpringRange> &ranges) const
+{
+	// sorting within a color keeps every color and kind range intact.
+	ranges = structuralSpringColors;
+	ranges.insert(ranges.end(), shearSpringColors.begin(), shearSpringColors.end());
+	ranges.insert(ranges.end(), flexSpringColors.begin(), flexSpringColors.end());
+}
+
+void ClothSystem::getConstrainedParticles(vector<int> &particles) const
+{
+	// the top corners, pinned or moved by evalF.
+	particles.clear();
+	particles.push_back(topRightCorner());
+	particles.push_back(topLeftCorner());
+	if (toggleSleeping)
+		sleepTiles.addSleepingParticles(particles);
+}
+
+void ClothSystem::addSpringForces(ParticleState &f, const Spring *from, const vector<SpringRange> &colors,
+								  const ParticleState &state)
+{
+	// springs of one color don't share particles, so a color can be split
+	// across threads without two of them writing the same force.
+	auto sum = [&](int start, int end)
 	{
-		Spring spring = springs.at(i);
-		Vector3f sf = springForce(spring, state);
-		f.at(spring.p0) += sf;
-		f.at(spring.p1) -= sf;
+		springForceKernel(from + start, end - start, state.px(), state.py(), state.pz(),
+						  f.vx(), f.vy(), f.vz());
+	};
+	for (const SpringRange &color : colors)
+	{
+		if (threadPool)
+			threadPool->parallelFor(color.start, color.end, sum);
+		else
+			sum(color.start, color.end);
+	}
+}
+
+void ClothSystem::addGridSpringForces(ParticleState &f, const ParticleState &state)
+{
+	const bool active[3] = {toggleStructure, toggleShear, toggleFlex};
+	GridSpring stencil[12];
+	int count = 0;
+	for (int kind = 0; kind < 3; ++kind)
+		if (active[kind])
+			for (const GridSpring &neighbor : m_gridStencil[kind])
+				stencil[count++] = neighbor;
+	// every row (or tile) only writes its own forces.
+	const int side = m_numParticlesPerSide;
+	if (toggleSleeping && !sleepTiles.empty() && m_originalIndex.empty())
+	{
+		// the tiles are in grid coordinates, which are the rows only without
+		// reordering. every run of awake tiles in a row of tiles is one block.
+		const int tilesPerSide = sleepTiles.tilesPerSide();
+		auto tileRows = [&](int begin, int end)
+		{
+			for (int tileRow = begin; tileRow < end; ++tileRow)
+			{
+				const int row = tileRow * sleepTileSize;
+				for (int tile = 0; tile < tilesPerSide;)
+				{
+					if (sleepTiles.asleep(tileRow * tilesPerSide + tile))
+					{
+						++tile;
+						continue;
+					}
+					int runEnd = tile + 1;
+					while (runEnd < tilesPerSide && !sleepTiles.asleep(tileRow * tilesPerSide + runEnd))
+						++runEnd;
+					gridSpringKernel(stencil, count, side, row, min(side, row + sleepTileSize),
+									 tile * sleepTileSize, min(side, runEnd * sleepTileSize),
+									 state.px(), state.py(), state.pz(), f.vx(), f.vy(), f.vz());
+					tile = runEnd;
+				}
+			}
+		};
+		if (threadPool)
+			threadPool->parallelFor(0, tilesPerSide, tileRows, max(1, 4096 / (sleepTileSize * side)));
+		else
+			tileRows(0, tilesPerSide);
+		return;
+	}
+	auto rows = [&](int begin, int end)
+	{
+		gridSpringKernel(stencil, count, side, begin, end, 0, side, state.px(), state.py(), state.pz(),
+						 f.vx(), f.vy(), f.vz());
+	};
+	if (threadPool)
+		threadPool->parallelFor(0, side, rows, max(1, 4096 / side));
+	else
+		rows(0, side);
+}
+
+void ClothSystem::updateAwakeSprings()
+{
+	const vector<SpringRange> *colors[3] = {&structuralSpringColors, &shearSpringColors, &flexSpringColors};
+	const float *awake = sleepTiles.awakeMask().data();
+	m_awakeSprings.clear();
+	for (int kind = 0; kind < 3; ++kind)
+	{
+		m_awakeSpringColors[kind].clear();
+		for (const SpringRange &color : *colors[kind])
+		{
+			int start = m_awakeSprings.size();
+			for (int i = color.start; i < color.end; ++i)
+				if (awake[springs[i].p0] != 0 || awake[springs[i].p1] != 0)
+					m_awakeSprings.push_back(springs[i]);
+			m_awakeSpringColors[kind].push_back(SpringRange{start, (int)m_awakeSprings.size()});
+		}
+	}
+	m_awakeSpringsGeneration = sleepTiles.generation();
+}
+
+void ClothSystem::prepareSleep()
+{
+	if (sleepTiles.empty())
+	{
+		// tiles of the grid, wherever reorderParticles put their particles.
+		const int side = m_numParticlesPerSide;
+		const int tilesPerSide = (side + sleepTileSize - 1) / sleepTileSize;
+		vector<int> tileOfParticle(m_numParticles);
+		for (int i = 0; i < m_numParticles; ++i)
+			tileOfParticle[particleIndex(i)] = i / side / sleepTileSize * tilesPerSide + i % side / sleepTileSize;
+		sleepTiles.build(tilesPerSide, tileOfParticle);
+	}
+	const std::array<float, 7> parameters = {float(toggleStructure), float(toggleShear), float(toggleFlex),
+											 float(toggleMoveAnchors), drag, particleMass, g};
+	if (parameters != m_sleepParameters)
+	{
+		sleepTiles.wakeAll();
+		m_sleepParameters = parameters;
+	}
+	if (toggleMoveAnchors)
+	{
+		sleepTiles.wake(sleepTiles.tileOf(topRightCorner()));
+		sleepTiles.wake(sleepTiles.tileOf(topLeftCorner()));
+	}
+}
+
+void ClothSystem::springsChanged()
+{
+	// the springs between a particle and the one (dRow, dCol) after it, per kind.
+	static const Dir offsets[3][2] = {{{1, 0}, {0, 1}}, {{1, 1}, {1, -1}}, {{2, 0}, {0, 2}}};
+	const SpringRange ranges[3] = {structuralSpringsRange, shearSpringsRange, flexSpringsRange};
+	const int side = m_numParticlesPerSide;
+	// the tiles may no longer fit the particles, the next step rebuilds them awake.
+	sleepTiles.clear();
+	selfCollision.springsChanged();
+	m_gridEdges.assign(m_numParticles, 0);
+	for (const Spring &s : springs)
+	{
+		int slot;
+		uint8_t edge = gridEdge(s, slot);
+		m_gridEdges[slot] |= edge;
 	}
+	m_hasGridStencil = false;
+	vector<char> seen;
+	for (int kind = 0; kind < 3; ++kind)
+	{
+		const SpringRange &sr = ranges[kind];
+		int expected = 0;
+		for (const Dir &o : offsets[kind])
+			expected += max(0, side - abs(o.dx)) * max(0, side - abs(o.dy));
+		if (sr.end - sr.start != expected)
+			return;
+		float k = expected ? springs[sr.start].k : 0.f;
+		float r = expected ? springs[sr.start].r : 0.f;
+		// with the count right, no spring twice and all of them grid neighbors means all are there.
+		seen.assign(2 * m_numParticles, 0);
+		for (int i = sr.start; i < sr.end; ++i)
+		{
+			const Spring &s = springs[i];
+			if (s.k != k || s.r != r)
+				return;
+			int a = min(s.p0, s.p1), b = max(s.p0, s.p1);
+			Dir d = {b / side - a / side, b % side - a % side};
+			int slot = -1;
+			for (int o = 0; o < 2; ++o)
+				if (d.dx == offsets[kind][o].dx && d.dy == offsets[kind][o].dy)
+					slot = o;
+			if (slot < 0 || seen[2 * a + slot])
+				return;
+			seen[2 * a + slot] = 1;
+		}
+		for (int o = 0; o < 2; ++o)
+		{
+			m_gridStencil[kind][2 * o] = GridSpring{offsets[kind][o].dx, offsets[kind][o].dy, k, r};
+			m_gridStencil[kind][2 * o + 1] = GridSpring{-offsets[kind][o].dx, -offsets[kind][o].dy, k, r};
+		}
+	}
+	m_hasGridStencil = true;
+}
+
+uint8_t ClothSystem::gridEdge(const Spring &s, int &slot) const
+{
+	const int side = m_numParticlesPerSide;
+	int a = originalIndex(s.p0), b = originalIndex(s.p1);
+	if (a > b)
+		swap(a, b);
+	slot = a;
+	int dRow = b / side - a / side, dCol = b % side - a % side;
+	if (dRow == 0 && dCol == 1)
+		return kNextColumn;
+	if (dRow == 1 && dCol == 0)
+		return kNextRow;
+	if (dRow == 1 && dCol == 1)
+		return kDiagonal;
+	if (dRow == 1 && dCol == -1)
+		return kAntiDiagonal;
+	return 0;
 }
 
-void ClothSystem::moveAnchorsLineMotion(vector<Vector3f> &d)
+Vector3f ClothSystem::anchorVelocity()
 {
-	static int dir = 1;
+	if (!toggleMoveAnchors)
+		return Vector3f::ZERO;
 	const float speed = 0.5f;
 	const float endZ = 20;
 	// move top corners by some func.
-	float currentZ = getPosition(m_numParticles - 1).z();
+	float currentZ = getPosition(topRightCorner()).z();
 	if (currentZ > endZ)
-		dir = -1;
+		m_anchorDirection = -1;
 	else if (currentZ < 0)
-		dir = 1;
+		m_anchorDirection = 1;
+	return Vector3f(0, 0, speed * m_anchorDirection);
+}
 
-	d.at(d.size() - 2) = Vector3f(0, 0, speed * dir);
+void ClothSystem::moveAnchorsLineMotion(ParticleState &d)
+{
+	Vector3f v = anchorVelocity();
+	d.setPosition(topRightCorner(), v);
 	// top left corner
-	d.at(d.size() - 2 * m_numParticlesPerSide) = Vector3f(0, 0, speed * dir);
+	d.setPosition(topLeftCorner(), v);
+}
+
+void ClothSystem::stepPositionBased(float stepSize, int iterations)
+{
+	ParticleState &state = m_vVecState;
+	if (m_predicted.size() != m_numParticles)
+		m_predicted.resize(m_numParticles);
+	const int topRight = topRightCorner();
+	const int topLeft = topLeftCorner();
+
+	// predict: v += h (g - drag v / m), with the drag taken implicitly so large
+	// steps stay stable, then p = x + h v. the anchors move on their own.
+	float *vx = state.vx(), *vy = state.vy(), *vz = state.vz();
+	float *x[3] = {state.px(), state.py(), state.pz()};
+	float *v[3] = {vx, vy, vz};
+	float *p[3] = {m_predicted.px(), m_predicted.py(), m_predicted.pz()};
+	const float damping = 1 / (1 + stepSize * drag / particleMass);
+	for (int i = 0; i < m_numParticles; ++i)
+	{
+		vx[i] *= damping;
+		vy[i] = (vy[i] - stepSize * g) * damping;
+		vz[i] *= damping;
+	}
+	// sleeping particles don't move, like the pinned ones.
+	const bool sleeping = toggleSleeping && !sleepTiles.empty();
+	const float *awake = sleeping ? sleepTiles.awakeMask().data() : nullptr;
+	if (sleeping)
+		for (int c = 0; c < 3; ++c)
+			for (int i = 0; i < m_numParticles; ++i)
+				v[c][i] *= awake[i];
+	Vector3f anchorV = anchorVelocity();
+	state.setVelocity(topRight, anchorV);
+	state.setVelocity(topLeft, anchorV);
+	for (int c = 0; c < 3; ++c)
+		for (int i = 0; i < m_numParticles; ++i)
+			p[c][i] = x[c][i] + stepSize * v[c][i];
+
+	// per iteration stiffness, so the overall stiffness doesn't depend on the iteration count.
+	const float stiffness = 1 - pow(1 - min(1.f, max(0.f, pbdStiffness)), 1.f / iterations);
+	m_activeColors.clear();
+	if (toggleStructure)
+		m_activeColors.insert(m_activeColors.end(), structuralSpringColors.begin(), structuralSpringColors.end());
+	if (toggleShear)
+		m_activeColors.insert(m_activeColors.end(), shearSpringColors.begin(), shearSpringColors.end());
+	if (toggleFlex)
+		m_activeColors.insert(m_activeColors.end(), flexSpringColors.begin(), flexSpringColors.end());
+
+	// gauss-seidel over the colors, each color in parallel since its springs
+	// don't share particles.
+	float *px = p[0], *py = p[1], *pz = p[2];
+	auto project = [&](int start, int end)
+	{
+		for (int i = start; i < end; ++i)
+		{
+			const Spring &s = springs[i];
+			float w0 = (s.p0 == topLeft || s.p0 == topRight) ? 0.f : 1.f;
+			float w1 = (s.p1 == topLeft || s.p1 == topRight) ? 0.f : 1.f;
+			if (awake)
+			{
+				w0 *= awake[s.p0];
+				w1 *= awake[s.p1];
+			}
+			if (w0 + w1 == 0)
+				continue;
+			float dx = px[s.p1] - px[s.p0];
+			float dy = py[s.p1] - py[s.p0];
+			float dz = pz[s.p1] - pz[s.p0];
+			float len = sqrt(dx * dx + dy * dy + dz * dz);
+			if (len == 0)
+				continue;
+			float scale = stiffness * (len - s.r) / (len * (w0 + w1));
+			px[s.p0] += w0 * scale * dx;
+			py[s.p0] += w0 * scale * dy;
+			pz[s.p0] += w0 * scale * dz;
+			px[s.p1] -= w1 * scale * dx;
+			py[s.p1] -= w1 * scale * dy;
+			pz[s.p1] -= w1 * scale * dz;
+		}
+	};
+	for (int it = 0; it < iterations; ++it)
+		for (const SpringRange &color : m_activeColors)
+		{
+			if (threadPool)
+				threadPool->parallelFor(color.start, color.end, project);
+			else
+				project(color.start, color.end);
+		}
+
+	// v = (p - x) / h, x = p.
+	for (int c = 0; c < 3; ++c)
+		for (int i = 0; i < m_numParticles; ++i)
+		{
+			v[c][i] = (p[c][i] - x[c][i]) / stepSize;
+			x[c][i] = p[c][i];
+		}
+}
+
+namespace
+{
+	const uint32_t kClothTag = checkpoint::tag("CLTH");
+	const uint32_t kColorsTag = checkpoint::tag("COLR");
+	const uint32_t kStrainLimitTag = checkpoint::tag("STRN");
+	const uint32_t kTearTag = checkpoint::tag("TEAR");
+	struct ClothParameters
+	{
+		int32_t numParticlesPerSide;
+		SpringRange structural, shear, flex;
+		// the colors section holds the structural, shear and flex colors in a row.
+		int32_t numStructuralColors, numShearColors, numFlexColors;
+		uint8_t toggleStructure, toggleShear, toggleFlex, showWireframe;
+		uint8_t toggleMoveAnchors, toggleSelfCollision;
+		int8_t anchorDirection; // 0 in old files, read as +1.
+		uint8_t toggleSleeping; // the tiles all start awake.
+		float pbdStiffness;
+		float selfCollisionThickness;
+	};
+	// a section of its own, older files don't have it.
+	struct StrainLimitParameters
+	{
+		uint8_t toggleStrainLimit;
+		uint8_t reserved[3];
+		float maxStretch;
+		int32_t iterations;
+	};
+	// the springs torn so far are just missing from the springs section.
+	struct TearParameters
+	{
+		uint8_t toggleTearing;
+		uint8_t reserved[3];
+		float tearStrain;
+	};
+}
+
+void ClothSystem::writeCheckpoint(checkpoint::Writer &out) const
+{
+	ParticleSpringSystem::writeCheckpoint(out);
+	ClothParameters cloth = {};
+	cloth.numParticlesPerSide = m_numParticlesPerSide;
+	cloth.structural = structuralSpringsRange;
+	cloth.shear = shearSpringsRange;
+	cloth.flex = flexSpringsRange;
+	cloth.numStructuralColors = structuralSpringColors.size();
+	cloth.numShearColors = shearSpringColors.size();
+	cloth.numFlexColors = flexSpringColors.size();
+	cloth.toggleStructure = toggleStructure;
+	cloth.toggleShear = toggleShear;
+	cloth.toggleFlex = toggleFlex;
+	cloth.showWireframe = showWireframe;
+	cloth.toggleMoveAnchors = toggleMoveAnchors;
+	cloth.toggleSelfCollision = toggleSelfCollision;
+	cloth.toggleSleeping = toggleSleeping;
+	cloth.anchorDirection = m_anchorDirection;
+	cloth.pbdStiffness = pbdStiffness;
+	cloth.selfCollisionThickness = selfCollision.thickness;
+	out.addValue(kClothTag, cloth);
+	vector<SpringRange> colors(structuralSpringColors);
+	colors.insert(colors.end(), shearSpringColors.begin(), shearSpringColors.end());
+	colors.insert(colors.end(), flexSpringColors.begin(), flexSpringColors.end());
+	out.addCopy(kColorsTag, colors.data(), colors.size() * sizeof(SpringRange));
+	StrainLimitParameters strainLimit = {};
+	strainLimit.toggleStrainLimit = toggleStrainLimit;
+	strainLimit.maxStretch = maxStretch;
+	strainLimit.iterations = strainLimitIterations;
+	out.addValue(kStrainLimitTag, strainLimit);
+	TearParameters tearing = {};
+	tearing.toggleTearing = toggleTearing;
+	tearing.tearStrain = tearStrain;
+	out.addValue(kTearTag, tearing);
 }
 
-void ClothSystem::drawLines(const SpringRange &sr)
+void ClothSystem::readCheckpoint(const checkpoint::Reader &in)
+{
+	ClothParameters cloth;
+	in.readValue(kClothTag, cloth);
+	vector<SpringRange> colors;
+	in.read(kColorsTag, colors);
+	const int numColors[3] = {cloth.numStructuralColors, cloth.numShearColors, cloth.numFlexColors};
+	if (numColors[0] < 0 || numColors[1] < 0 || numColors[2] < 0 ||
+		colors.size() != size_t(numColors[0]) + numColors[1] + numColors[2])
+		throw std::runtime_error("checkpoint spring colors don't match their counts");
+	LoadedSprings loaded;
+	readSprings(in, loaded);
+	if (cloth.numParticlesPerSide < 0 ||
+		loaded.state.size() != int64_t(cloth.numParticlesPerSide) * cloth.numParticlesPerSide)
+		throw std::runtime_error("checkpoint particle count isn't a square grid");
+	// the kinds lie back to back over all springs, each split into back to back colors.
+	const SpringRange kinds[3] = {cloth.structural, cloth.shear, cloth.flex};
+	int next = 0;
+	auto color = colors.begin();
+	for (int kind = 0; kind < 3; ++kind)
+	{
+		if (kinds[kind].start != next || kinds[kind].end < next || kinds[kind].end > (int)loaded.springs.size())
+			throw std::runtime_error("checkpoint spring ranges don't cover the springs");
+		for (int c = 0; c < numColors[kind]; ++c, ++color)
+		{
+			if (color->start != next || color->end < next || color->end > kinds[kind].end)
+				throw std::runtime_error("checkpoint spring colors don't cover their range");
+			next = color->end;
+		}
+		if (next != kinds[kind].end)
+			throw std::runtime_error("checkpoint spring colors don't cover their range");
+	}
+	if (next != (int)loaded.springs.size())
+		throw std::runtime_error("checkpoint spring ranges don't cover the springs");
+	// older files don't have these.
+	size_t bytes;
+	StrainLimitParameters strainLimit = {};
+	strainLimit.maxStretch = maxStretch;
+	strainLimit.iterations = strainLimitIterations;
+	if (in.find(kStrainLimitTag, bytes))
+		in.readValue(kStrainLimitTag, strainLimit);
+	TearParameters tearing = {};
+	tearing.tearStrain = tearStrain;
+	if (in.find(kTearTag, bytes))
+		in.readValue(kTearTag, tearing);
+
+	useSprings(loaded);
+	m_numParticlesPerSide = cloth.numParticlesPerSide;
+	structuralSpringsRange = cloth.structural;
+	shearSpringsRange = cloth.shear;
+	flexSpringsRange = cloth.flex;
+	color = colors.begin();
+	structuralSpringColors.assign(color, color + cloth.numStructuralColors);
+	color += cloth.numStructuralColors;
+	shearSpringColors.assign(color, color + cloth.numShearColors);
+	color += cloth.numShearColors;
+	flexSpringColors.assign(color, color + cloth.numFlexColors);
+	toggleStructure = cloth.toggleStructure;
+	toggleShear = cloth.toggleShear;
+	toggleFlex = cloth.toggleFlex;
+	showWireframe = cloth.showWireframe;
+	toggleMoveAnchors = cloth.toggleMoveAnchors;
+	toggleSelfCollision = cloth.toggleSelfCollision;
+	toggleSleeping = cloth.toggleSleeping;
+	m_anchorDirection = cloth.anchorDirection < 0 ? -1 : 1;
+	pbdStiffness = cloth.pbdStiffness;
+	selfCollision.thickness = cloth.selfCollisionThickness;
+	toggleStrainLimit = strainLimit.toggleStrainLimit;
+	maxStretch = strainLimit.maxStretch;
+	strainLimitIterations = strainLimit.iterations;
+	toggleTearing = tearing.toggleTearing;
+	tearStrain = tearing.tearStrain;
+	m_numTornSprings = 0;
+	notifySpringsChanged();
+	// nothing to sweep the obstacles from until the next step starts.
+	m_stepStart.resize(0);
+}
+
+void ClothSystem::beforeStep(float stepSize)
+{
+	// waking tiles changes which particles evalF holds still.
+	if (toggleSleeping)
+	{
+		prepareSleep();
+		stateChanged();
+	}
+	else if (!sleepTiles.empty())
+	{
+		sleepTiles.clear();
+		stateChanged();
+	}
+	if (!obstacles.empty() || toggleSleeping)
+		m_stepStart = m_vVecState;
+}
+
+void ClothSystem::afterStep(float stepSize)
+{
+	const bool sleeping = toggleSleeping && !sleepTiles.empty();
+	if (!toggleTearing && !toggleStrainLimit && !toggleSelfCollision && obstacles.empty() && !sleeping)
+		return;
+	stateChanged();
+	if (toggleTearing)
+		tear();
+	// sleeping particles are pinned for the strain limit and collisions too.
+	getConstrainedParticles(m_constrained);
+	if (toggleStrainLimit)
+		limitStrain(stepSize);
+	if (toggleSelfCollision)
+	{
+		selfCollision.resolve(m_vVecState, springs, m_constrained, threadPool);
+		// an awake particle ran into a sleeping one.
+		if (sleeping)
+			for (int i = 0; i < m_numParticles; ++i)
+				if (sleepTiles.awakeMask()[i] == 0 && selfCollision.pushedAgainst(i))
+					sleepTiles.wake(sleepTiles.tileOf(i));
+	}
+	// beforeStep wasn't called (or the size changed), nothing to sweep from.
+	if (m_stepStart.size() != m_numParticles)
+		return;
+	if (!obstacles.empty())
+	{
+		m_isConstrained.assign(m_numParticles, 0);
+		for (int p : m_constrained)
+			m_isConstrained[p] = 1;
+	}
+	for (const Obstacle *obstacle : obstacles)
+		obstacle->collide(m_vVecState, m_stepStart, m_isConstrained, threadPool);
+	if (sleeping)
+		sleepTiles.update(m_vVecState, m_stepStart, stepSize, threadPool);
+}
+
+void ClothSystem::limitStrain(float stepSize)
+{
+	m_strainWeights.assign(m_numParticles, 1.f);
+	for (int p : m_constrained)
+		m_strainWeights[p] = 0;
+	m_activeColors.clear();
+	if (toggleStructure)
+		m_activeColors.insert(m_activeColors.end(), structuralSpringColors.begin(), structuralSpringColors.end());
+	if (toggleShear)
+		m_activeColors.insert(m_activeColors.end(), shearSpringColors.begin(), shearSpringColors.end());
+
+	float *px = m_vVecState.px(), *py = m_vVecState.py(), *pz = m_vVecState.pz();
+	float *vx = m_vVecState.vx(), *vy = m_vVecState.vy(), *vz = m_vVecState.vz();
+	const float *w = m_strainWeights.data();
+	const float maxFactor = 1 + maxStretch;
+	const float invStep = 1 / stepSize;
+	m_strainCorrections = 0;
+	auto limit = [&](int start, int end)
+	{
+		int corrections = 0;
+		for (int i = start; i < end; ++i)
+		{
+			const Spring &s = springs[i];
+			float w0 = w[s.p0], w1 = w[s.p1];
+			if (w0 + w1 == 0)
+				continue;
+			float dx = px[s.p1] - px[s.p0];
+			float dy = py[s.p1] - py[s.p0];
+			float dz = pz[s.p1] - pz[s.p0];
+			float len = sqrt(dx * dx + dy * dy + dz * dz);
+			float maxLen = maxFactor * s.r;
+			if (len <= maxLen)
+				continue;
+			float scale = (len - maxLen) / (len * (w0 + w1));
+			float cx = scale * dx, cy = scale * dy, cz = scale * dz;
+			px[s.p0] += w0 * cx;
+			py[s.p0] += w0 * cy;
+			pz[s.p0] += w0 * cz;
+			px[s.p1] -= w1 * cx;
+			py[s.p1] -= w1 * cy;
+			pz[s.p1] -= w1 * cz;
+			vx[s.p0] += w0 * invStep * cx;
+			vy[s.p0] += w0 * invStep * cy;
+			vz[s.p0] += w0 * invStep * cz;
+			vx[s.p1] -= w1 * invStep * cx;
+			vy[s.p1] -= w1 * invStep * cy;
+			vz[s.p1] -= w1 * invStep * cz;
+			++corrections;
+		}
+		m_strainCorrections += corrections;
+	};
+	// gauss-seidel over the colors like stepPositionBased, a color's springs
+	// don't share particles.
+	for (int it = 0; it < strainLimitIterations; ++it)
+		for (const SpringRange &color : m_activeColors)
+		{
+			if (threadPool)
+				threadPool->parallelFor(color.start, color.end, limit);
+			else
+				limit(color.start, color.end);
+		}
+}
+
+void ClothSystem::tear()
+{
+	const float *px = m_vVecState.px(), *py = m_vVecState.py(), *pz = m_vVecState.pz();
+	const float maxFactor = 1 + tearStrain;
+	m_tearCandidates.resize(springs.size());
+	m_numTearCandidates = 0;
+	auto find = [&](int start, int end)
+	{
+		for (int i = start; i < end; ++i)
+		{
+			const Spring &s = springs[i];
+			float dx = px[s.p1] - px[s.p0];
+			float dy = py[s.p1] - py[s.p0];
+			float dz = pz[s.p1] - pz[s.p0];
+			float maxLen = maxFactor * s.r;
+			if (dx * dx + dy * dy + dz * dz > maxLen * maxLen)
+				m_tearCandidates[m_numTearCandidates++] = i;
+		}
+	};
+	if (threadPool)
+		threadPool->parallelFor(0, springs.size(), find);
+	else
+		find(0, springs.size());
+	const int numCandidates = m_numTearCandidates;
+	if (numCandidates == 0)
+		return;
+
+	vector<SpringRange *> colors, awakeColors;
+	for (vector<SpringRange> *kind : {&structuralSpringColors, &shearSpringColors, &flexSpringColors})
+		for (SpringRange &color : *kind)
+			colors.push_back(&color);
+	for (vector<SpringRange> &kind : m_awakeSpringColors)
+		for (SpringRange &color : kind)
+			awakeColors.push_back(&color);
+	// removing a spring only moves the springs behind it, so going from the
+	// back the other candidates keep their index.
+	sort(m_tearCandidates.begin(), m_tearCandidates.begin() + numCandidates, greater<int>());
+	lock_guard<mutex> lock(m_topologyMutex);
+	for (int i = 0; i < numCandidates; ++i)
+		removeSpring(m_tearCandidates[i], colors, awakeColors);
+	m_hasGridStencil = false;
+	bumpSpringsGeneration();
+}
+
+void ClothSystem::removeSpring(int index, const vector<SpringRange *> &colors,
+							   const vector<SpringRange *> &awakeColors)
+{
+	const Spring removed = springs[index];
+	const int color = swapRemove(springs, colors, index);
+	// the kinds are unions of consecutive colors.
+	for (SpringRange *kind : {&structuralSpringsRange, &shearSpringsRange, &flexSpringsRange})
+		if (index < kind->end)
+		{
+			if (index < kind->start)
+				--kind->start;
+			--kind->end;
+		}
+	// the awake springs have a range for every color, and p0, p1 are unique within one.
+	if (m_awakeSpringsGeneration == sleepTiles.generation())
+	{
+		const SpringRange &awake = *awakeColors[color];
+		for (int i = awake.start; i < awake.end; ++i)
+			if (m_awakeSprings[i].p0 == removed.p0 && m_awakeSprings[i].p1 == removed.p1)
+			{
+				swapRemove(m_awakeSprings, awakeColors, i);
+				break;
+			}
+	}
+	selfCollision.removeSpring(removed.p0, removed.p1);
+	int slot;
+	uint8_t edge = gridEdge(removed, slot);
+	m_gridEdges[slot] &= ~edge;
+	++m_numTornSprings;
+}
+
+void ClothSystem::drawLines(const SpringRange &sr, const ParticleState &state)
 {
 	for (int i = sr.start; i < sr.end; ++i)
 	{
 		Spring spring = springs.at(i);
-		float f = springForce(spring).abs();
+		float f = springForce(spring, state).abs();
 
 		glColor3f(f / 2, f / 2, f / 2);
 
@@ -168,9 +902,9 @@ void ClothSystem::drawLines(const SpringRange &sr)
 		glBegin(GL_LINES);
 
 		// Define the start point of the line
-		glVertex3fv(getPosition(spring.p0));
+		glVertex3fv(getPosition(spring.p0, state));
 		// Define the end point of the line
-		glVertex3fv(getPosition(spring.p1));
+		glVertex3fv(getPosition(spring.p1, state));
 		glEnd(); // End the drawing block
 		glPopMatrix();
 	}
@@ -178,12 +912,18 @@ void ClothSystem::drawLines(const SpringRange &sr)
 
 void ClothSystem::draw()
 {
+	draw(m_vVecState);
+}
+
+void ClothSystem::draw(const ParticleState &state)
+{
+	lock_guard<mutex> lock(m_topologyMutex);
 	if (showWireframe)
 	{
 		// draw particles
 		for (int i = 0; i < m_numParticles; i++)
 		{
-			Vector3f pos = getPosition(i);
+			Vector3f pos = getPosition(i, state);
 			glPushMatrix();
 			glTranslatef(pos[0], pos[1], pos[2]);
 			glutSolidSphere(0.075f, 10.0f, 10.0f);
@@ -192,42 +932,60 @@ void ClothSystem::draw()
 
 		// draw activated springs.
 		if (toggleStructure)
-			drawLines(structuralSpringsRange);
+			drawLines(structuralSpringsRange, state);
 		if (toggleShear)
-			drawLines(shearSpringsRange);
+			drawLines(shearSpringsRange, state);
 		if (toggleFlex)
-			drawLines(flexSpringsRange);
+			drawLines(flexSpringsRange, state);
 	}
 	else // show mesh
 	{
 		glPushAttrib(GL_LIGHTING_BIT | GL_ENABLE_BIT);
 		glDisable(GL_CULL_FACE);
 		// glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
-		for (int i = 0; i < m_numParticlesPerSide - 1; ++i)
-			for (int j = 0; j < m_numParticlesPerSide - 1; ++j)
+		const int side = m_numParticlesPerSide;
+		auto triangle = [](const Vector3f &a, const Vector3f &b, const Vector3f &c)
+		{
+			glNormal3fv(Vector3f::cross(b - a, c - b).normalized());
+			glVertex3fv(a);
+			glVertex3fv(b);
+			glVertex3fv(c);
+		};
+		glBegin(GL_TRIANGLES);
+		for (int i = 0; i < side - 1; ++i)
+			for (int j = 0; j < side - 1; ++j)
 			{
 				/**
 				 * v3---v2
 				 * |    |
 				 * v0---v1
 				 */
-				Vector3f v0 = getPosition(i, j);
-				Vector3f v1 = getPosition(i, j + 1);
-				Vector3f v2 = getPosition(i + 1, j + 1);
-				Vector3f v3 = getPosition(i + 1, j);
-				Vector3f normal1 = Vector3f::cross(v1 - v0, v2 - v1).normalized();
-				Vector3f normal2 = Vector3f::cross(v3 - v2, v0 - v3).normalized();
-				glBegin(GL_TRIANGLES);
-				glNormal3fv(normal1);
-				glVertex3fv(v0);
-				glVertex3fv(v1);
-				glVertex3fv(v2);
-				glNormal3fv(normal2);
-				glVertex3fv(v2);
-				glVertex3fv(v3);
-				glVertex3fv(v0);
-				glEnd();
+				Vector3f v0 = getPosition(i, j, state);
+				Vector3f v1 = getPosition(i, j + 1, state);
+				Vector3f v2 = getPosition(i + 1, j + 1, state);
+				Vector3f v3 = getPosition(i + 1, j, state);
+				// a triangle is drawn while its three edges haven't torn, split
+				// along the anti-diagonal once the diagonal tore.
+				uint8_t e0 = m_gridEdges[i * side + j], e1 = m_gridEdges[i * side + j + 1];
+				uint8_t e3 = m_gridEdges[(i + 1) * side + j];
+				bool bottom = e0 & kNextColumn, left = e0 & kNextRow;
+				bool right = e1 & kNextRow, top = e3 & kNextColumn;
+				if (e0 & kDiagonal)
+				{
+					if (bottom && right)
+						triangle(v0, v1, v2);
+					if (top && left)
+						triangle(v2, v3, v0);
+				}
+				else if (e1 & kAntiDiagonal)
+				{
+					if (bottom && left)
+						triangle(v3, v0, v1);
+					if (right && top)
+						triangle(v1, v2, v3);
+				}
 			}
+		glEnd();
 		glPopAttrib();
 	}
 }
\ No newline at end of file
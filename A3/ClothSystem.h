@@ -1,28 +1,30 @@
 #ifndef CLOTHSYSTEM_H
 #define CLOTHSYSTEM_H
 
+#include <array>
+#include <atomic>
+#include <mutex>
 #include <vecmath.h>
 #include <vector>
 
+#include "obstacle.h"
 #include "pendulumSystem.h"
+#include "selfCollision.h"
+#include "sleepTiles.h"
 #include "Spring.h"
+#include "threadPool.h"
 struct Dir
 {
 	int dx, dy;
 };
 
-struct SpringRange
-{
-	int start, end;
-};
-
 class ClothSystem : public ParticleSpringSystem
 {
 public:
 	using ParticleSpringSystem::getPosition;
 	using ParticleSpringSystem::getVelocity;
-	Vector3f getPosition(int i, int j,const vector<Vector3f> &state);
-	Vector3f getVelocity(int i, int j,const vector<Vector3f> &state);
+	Vector3f getPosition(int i, int j, const ParticleState &state);
+	Vector3f getVelocity(int i, int j, const ParticleState &state);
 	Vector3f getPosition(int i, int j);
 	Vector3f getVelocity(int i, int j);
 	/**
@@ -33,23 +35,172 @@ public:
 	 * @brief create plane of particles
 	 */
 	ClothSystem(unsigned numParticlesPerSide);
-	vector<Vector3f> evalF(vector<Vector3f> state) override;
+	void evalF(const ParticleState &state, ParticleState &f) override;
+	void getActiveSpringRanges(vector<SpringRange> &ranges) const override;
+	void getConstrainedParticles(vector<int> &particles) const override;
+	/**
+	 * @brief position based dynamics step (Mueller et al. 07): the active springs
+	 * are distance constraints, projected by graph colored gauss-seidel for
+	 * iterations sweeps. gravity and drag are the only forces.
+	 */
+	void stepPositionBased(float stepSize, int iterations);
+	// remembers where the particles start the step, for the obstacles and the
+	// sleep tiles, and wakes the tiles that have to.
+	void beforeStep(float stepSize) override;
+	// tears the springs if toggleTearing, limits the strain if toggleStrainLimit,
+	// runs the self collision pass if
+	// toggleSelfCollision, then the obstacles, then updates the sleep tiles.
+	void afterStep(float stepSize) override;
 	void draw() override;
-	bool toggleStructure = true;
-	bool toggleShear = true;
-	bool toggleFlex = true;
+	// draws the cloth in state, e.g. a frame published by a SimulationThread.
+	void draw(const ParticleState &state);
+	// read by draw too, which may run on another thread than the steps.
+	std::atomic<bool> toggleStructure{true};
+	std::atomic<bool> toggleShear{true};
+	std::atomic<bool> toggleFlex{true};
 	bool showWireframe = true;
 	bool toggleMoveAnchors = false;
+	bool toggleSelfCollision = false;
 	int m_numParticlesPerSide;
+	// pool the spring forces are computed on, nullptr runs them serially.
+	ThreadPool *threadPool = &ThreadPool::shared();
+	/**
+	 * @brief evalF walks the grid with the structural, shear and flex stencils
+	 * instead of the springs while they are still the regular grid (see
+	 * hasGridStencil). the forces sum up in another order than over the
+	 * springs, so they differ in the last bits.
+	 */
+	bool useGridStencil = true;
+	GridSpringKernel gridSpringKernel = bestGridSpringKernel();
+	// true while every spring kind has all its grid springs, with one k and rest length.
+	bool hasGridStencil() const { return m_hasGridStencil; }
+	// constraint stiffness of stepPositionBased, 1 is inextensible.
+	float pbdStiffness = 1.f;
+	// particle-particle contacts, set selfCollision.thickness below the
+	// rest distance of particles without a spring between them. the closest
+	// such pair is a (2, 1) grid offset apart, sqrt(5) (two apart in a row
+	// or column are joined by a flex spring).
+	SelfCollision selfCollision;
+	// static meshes the particles can't pass through, not owned.
+	vector<const Obstacle *> obstacles;
+	/**
+	 * @brief lets tiles of sleepTileSize x sleepTileSize particles that came to
+	 * rest fall asleep (see SleepTiles for the thresholds). getConstrainedParticles
+	 * lists the sleeping particles, so the steppers hold them still, and evalF
+	 * skips their springs. tiles wake up next to moving ones, at the moving
+	 * anchors, when an awake particle runs into them (self collision) and when
+	 * a toggle or the drag, mass or gravity changes.
+	 */
+	bool toggleSleeping = false;
+	SleepTiles sleepTiles;
+	int sleepTileSize = 8;
+	/**
+	 * @brief strain limiting after every step (Provot 95): structural and shear
+	 * springs longer than (1 + maxStretch) r are shortened to that, moving both
+	 * ends (or only the free one of a pinned pair) by the same amount, and the
+	 * moved particles' velocities by the move over the step. runs
+	 * strainLimitIterations gauss-seidel sweeps over the spring colors, each
+	 * color in parallel. keeps soft springs from over-stretching at large steps.
+	 */
+	bool toggleStrainLimit = false;
+	float maxStretch = 0.1f;
+	int strainLimitIterations = 4;
+	// springs the last strain limiting pass shortened, counted once per iteration.
+	int lastStrainCorrections() const { return m_strainCorrections; }
+	/**
+	 * @brief tearing: after every step the springs (of any kind) stretched past
+	 * (1 + tearStrain) r are removed. springs stays dense, the colors and kinds
+	 * just get shorter (see removeSpring), and the mesh leaves out the triangles
+	 * that lost an edge. evalF falls back to the springs from the first tear on.
+	 * draw waits while springs are removed, so it can run on another thread.
+	 */
+	bool toggleTearing = false;
+	float tearStrain = 0.5f;
+	// springs torn since the cloth was set up or loaded.
+	int numTornSprings() const { return m_numTornSprings; }
+
+protected:
+	// adds the grid size, the spring ranges and their colors, and the toggles.
+	void writeCheckpoint(checkpoint::Writer &out) const override;
+	void readCheckpoint(const checkpoint::Reader &in) override;
+	// checks whether the springs are still the regular grid and updates the stencil,
+	// which also needs the particles in row order (so not after reorderParticles).
+	void springsChanged() override;
+	// the spring colors.
+	void getSortableSpringRanges(vector<SpringRange> &ranges) const override;
 
 private:
 	void addSpringsAroundParticle(vector<Dir> &SpringDirs, int i, int j);
-	void addSpringForces(std::vector<Vector3f> &f, const SpringRange &sr, const vector<Vector3f> &state);
-	void moveAnchorsLineMotion(vector<Vector3f> &d);
-	void drawLines(const SpringRange &sr);
+	// the forces of the colors of from, in parallel within each color.
+	void addSpringForces(ParticleState &f, const Spring *from, const vector<SpringRange> &colors,
+						 const ParticleState &state);
+	// the forces of the active spring kinds from the stencil, in parallel over rows
+	// (or over the awake tiles).
+	void addGridSpringForces(ParticleState &f, const ParticleState &state);
+	// builds the sleep tiles if there are none, wakes them all if a toggle or
+	// parameter changed and wakes the tiles of moving anchors.
+	void prepareSleep();
+	// copies the springs with an awake end into m_awakeSprings, color by color.
+	void updateAwakeSprings();
+	// the strain limiting pass, m_constrained has to hold the pinned particles.
+	void limitStrain(float stepSize);
+	// removes the springs stretched past tearStrain, in parallel to find them.
+	void tear();
+	/**
+	 * @brief removes springs[index] without leaving a hole: the last spring of its
+	 * color takes its place, the first slot of every later color takes that
+	 * color's last spring and the color moves down by one. the awake springs
+	 * and the self collision adjacency lose the spring the same way.
+	 * colors and awakeColors are all colors of all kinds, in order.
+	 */
+	void removeSpring(int index, const vector<SpringRange *> &colors, const vector<SpringRange *> &awakeColors);
+	// slot and bit of s in m_gridEdges, bit 0 for springs that aren't mesh edges.
+	uint8_t gridEdge(const Spring &s, int &slot) const;
+	void moveAnchorsLineMotion(ParticleState &d);
+	// the pinned (or driven) top corners, wherever reorderParticles put them.
+	int topRightCorner() const { return particleIndex(m_numParticles - 1); }
+	int topLeftCorner() const { return particleIndex(m_numParticles - m_numParticlesPerSide); }
+	// velocity of the top corners, 0 unless toggleMoveAnchors.
+	Vector3f anchorVelocity();
+	// +1 while the anchors move towards +z, -1 on the way back.
+	int m_anchorDirection = 1;
+	void drawLines(const SpringRange &sr, const ParticleState &state);
 	SpringRange structuralSpringsRange;
 	SpringRange shearSpringsRange;
 	SpringRange flexSpringsRange;
+	// color classes of each range, see colorSprings.
+	vector<SpringRange> structuralSpringColors;
+	vector<SpringRange> shearSpringColors;
+	vector<SpringRange> flexSpringColors;
+	// structural, shear and flex neighbors in both directions, valid if m_hasGridStencil.
+	GridSpring m_gridStencil[3][4];
+	bool m_hasGridStencil = false;
+	// stepPositionBased scratch.
+	ParticleState m_predicted;
+	vector<SpringRange> m_activeColors;
+	vector<int> m_constrained;
+	// m_constrained as a flag per particle, for the obstacles.
+	vector<char> m_isConstrained;
+	ParticleState m_stepStart;
+	// springs evalF sums up while tiles sleep, colors of every kind.
+	vector<Spring> m_awakeSprings;
+	vector<SpringRange> m_awakeSpringColors[3];
+	unsigned m_awakeSpringsGeneration = ~0u;
+	// toggles, drag, mass and gravity when prepareSleep last ran.
+	std::array<float, 7> m_sleepParameters = {};
+	// limitStrain scratch, 0 for pinned particles and 1 for the others.
+	vector<float> m_strainWeights;
+	std::atomic<int> m_strainCorrections{0};
+	// tear scratch, the indices of the springs to remove.
+	vector<int> m_tearCandidates;
+	std::atomic<int> m_numTearCandidates{0};
+	int m_numTornSprings = 0;
+	// the mesh edges (structural and shear springs) still there, a bit per
+	// direction at the lower end's grid index. read by draw.
+	vector<uint8_t> m_gridEdges;
+	// held by tear while it removes springs and by draw while it reads the
+	// springs, their ranges and m_gridEdges.
+	std::mutex m_topologyMutex;
 };
 
 #endif
@@ -7,4 +7,10 @@ struct Spring {
 	float r;    // rest length
 };
 
+// springs [start, end) of a system's springs vector.
+struct SpringRange
+{
+	int start, end;
+};
+
 #endif
@@ -1,29 +1,155 @@
 #include "TimeStepper.hpp"
+#include "ClothSystem.h"
+#include <iostream>
+#include <stdexcept>
 
-/// TODO: implement Explicit Euler time integrator here
-void ForwardEuler::takeStep(ParticleSystem *particleSystem, float stepSize)
+namespace
 {
-    const vector<Vector3f> &oldState = particleSystem->getState();
-    vector<Vector3f> eval = particleSystem->evalF(oldState);
-    vector<Vector3f> newState;
-    for (unsigned i = 0; i < eval.size(); ++i)
-        newState.push_back(oldState.at(i) + stepSize * eval.at(i));
-    particleSystem->setState(newState);
+    // (re)allocates a scratch state only when the particle count changed.
+    void matchSize(ParticleState &scratch, const ParticleState &state)
+    {
+        if (scratch.size() != state.size())
+            scratch.resize(state.size());
+    }
+
+    // the in place steppers integrate the velocities themselves, so particles
+    // with prescribed motion get the velocity evalF put in their position slot
+    // and no acceleration.
+    void applyConstraints(ParticleSystem *particleSystem, vector<int> &constrained, ParticleState &f)
+    {
+        if (ParticleSpringSystem *system = dynamic_cast<ParticleSpringSystem *>(particleSystem))
+            system->getConstrainedParticles(constrained);
+        else
+            constrained.clear();
+        ParticleState &state = particleSystem->getMutableState();
+        for (int p : constrained)
+        {
+            state.setVelocity(p, f.getPosition(p));
+            f.setVelocity(p, Vector3f::ZERO);
+        }
+    }
+}
+
+void SymplecticEuler::takeStep(ParticleSystem *particleSystem, float stepSize)
+{
+    ParticleState &state = particleSystem->getMutableState();
+    matchSize(m_f, state);
+    particleSystem->evalF(state, m_f);
+    applyConstraints(particleSystem, m_constrained, m_f);
+    const int n = 3 * state.stride();
+    float *x = state.data(), *v = state.data() + n;
+    const float *a = m_f.data() + n;
+    for (int i = 0; i < n; ++i)
+    {
+        v[i] += stepSize * a[i];
+        x[i] += stepSize * v[i];
+    }
+}
+
+void VelocityVerlet::takeStep(ParticleSystem *particleSystem, float stepSize)
+{
+    ParticleState &state = particleSystem->getMutableState();
+    // a(t) is the a(t + h) of the last step, unless the state changed since.
+    if (particleSystem->stateGeneration() != m_generation || m_f.size() != state.size())
+    {
+        matchSize(m_f, state);
+        particleSystem->evalF(state, m_f);
+    }
+    applyConstraints(particleSystem, m_constrained, m_f);
+    const int n = 3 * state.stride();
+    float *x = state.data(), *v = state.data() + n;
+    const float *a = m_f.data() + n;
+    const float halfStep = stepSize / 2;
+    // v(t + h/2) = v + h/2 a(t), x(t + h) = x + h v(t + h/2)
+    for (int i = 0; i < n; ++i)
+    {
+        v[i] += halfStep * a[i];
+        x[i] += stepSize * v[i];
+    }
+    particleSystem->evalF(state, m_f);
+    applyConstraints(particleSystem, m_constrained, m_f);
+    // v(t + h) = v(t + h/2) + h/2 a(t + h)
+    for (int i = 0; i < n; ++i)
+        v[i] += halfStep * a[i];
+    m_generation = particleSystem->stateGeneration();
+}
+
+void PositionBasedDynamics::takeStep(ParticleSystem *particleSystem, float stepSize)
+{
+    ClothSystem *cloth = dynamic_cast<ClothSystem *>(particleSystem);
+    if (!cloth)
+        throw invalid_argument("position based dynamics only works on cloth.");
+    cloth->stepPositionBased(stepSize, iterations);
 }
 
-/// TODO: implement Trapzoidal rule here
-void Trapzoidal::takeStep(ParticleSystem *particleSystem, float stepSize)
+TimeStepper *createTimeStepper(const std::string &solvertype, bool quiet)
 {
-    const vector<Vector3f> &oldState = particleSystem->getState();
-    vector<Vector3f> eval = particleSystem->evalF(oldState);
-    vector<Vector3f> evalNext;
-    vector<Vector3f> newState;
-    // getting "next" state
-    for (unsigned i = 0; i < eval.size(); ++i)
-        evalNext.push_back(oldState.at(i) + stepSize * eval.at(i));
-    evalNext = particleSystem->evalF(evalNext);
-    // averaging evaluations.
-    for (unsigned i = 0; i < eval.size(); ++i)
-        newState.push_back(oldState.at(i) + stepSize * (eval.at(i) + evalNext.at(i)) / 2);
-    particleSystem->setState(newState);
+    // only the explicit runge-kutta steppers take the c suffix.
+    const bool compressed = solvertype.size() > 1 && solvertype.back() == 'c';
+    const std::string rk = compressed ? solvertype.substr(0, solvertype.size() - 1) : solvertype;
+    const char *storage = compressed ? " with compressed stages" : "";
+    if (rk == "e")
+    {
+        if (!quiet)
+            cout << "using Forward Euler" << storage << endl;
+        return new ForwardEuler(compressed);
+    }
+    else if (rk == "t")
+    {
+        if (!quiet)
+            cout << "using Trapezoidal" << storage << endl;
+        return new Trapzoidal(compressed);
+    }
+    else if (rk == "m")
+    {
+        if (!quiet)
+            cout << "using Midpoint" << storage << endl;
+        return new Midpoint(compressed);
+    }
+    else if (rk == "r")
+    {
+        if (!quiet)
+            cout << "using RK4" << storage << endl;
+        return new RK4(compressed);
+    }
+    else if (rk == "38")
+    {
+        if (!quiet)
+            cout << "using RK 3/8 rule" << storage << endl;
+        return new ThreeEighths(compressed);
+    }
+    else if (solvertype == "i")
+    {
+        if (!quiet)
+            cout << "using Implicit Euler" << endl;
+        return new ImplicitEuler();
+    }
+    else if (solvertype == "d")
+    {
+        if (!quiet)
+            cout << "using adaptive Dormand-Prince" << endl;
+        return new DormandPrince();
+    }
+    else if (solvertype == "s")
+    {
+        if (!quiet)
+            cout << "using Symplectic Euler" << endl;
+        return new SymplecticEuler();
+    }
+    else if (solvertype == "v")
+    {
+        if (!quiet)
+            cout << "using Velocity Verlet" << endl;
+        return new VelocityVerlet();
+    }
+    else if (solvertype == "p")
+    {
+        if (!quiet)
+            cout << "using Position Based Dynamics" << endl;
+        return new PositionBasedDynamics();
+    }
+    throw invalid_argument("can only choose e - forwardeuler, t - trapzoidal, m - midpoint, r - rk4, "
+                           "38 - rk 3/8 rule (add c for compressed stages, e.g. rc), i - implicit euler, "
+                           "d - dormand-prince, s - symplectic euler, v - velocity verlet, "
+                           "or p - position based dynamics.");
 }
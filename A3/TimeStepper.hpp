@@ -2,33 +2,369 @@
 #define INTEGRATOR_H
 
 #include "vecmath.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <utility>
 #include <vector>
+#include "compressedState.h"
 #include "particleSystem.h"
+#include "Spring.h"
 
 class TimeStepper
 {
 public:
+	virtual ~TimeStepper() {}
 	virtual void takeStep(ParticleSystem* particleSystem,float stepSize)=0;
+	// true once the stepper gave up on the system (see DormandPrince), its
+	// steps leave the state alone from then on.
+	virtual bool failed() const { return false; }
+	// takeStep between the system's beforeStep and afterStep, what the drivers call.
+	void step(ParticleSystem* particleSystem, float stepSize)
+	{
+		particleSystem->beforeStep(stepSize);
+		takeStep(particleSystem, stepSize);
+		particleSystem->afterStep(stepSize);
+	}
 };
 
 //IMPLEMENT YOUR TIMESTEPPERS
+// the steppers keep their derivatives and intermediate states as members,
+// so after the first step (or a change in particle count) a step
+// doesn't allocate.
 
-class ForwardEuler:public TimeStepper
+/**
+ * @brief explicit runge-kutta method given by its butcher tableau T:
+ * a struct with static constexpr int stages and float a[stages][stages],
+ * b[stages] and c[stages]. the coefficients are template constants, so
+ * every stage combination compiles to one fused loop over the flat state
+ * holding just the non zero terms.
+ * with compressedStorage the stages the later combinations still need are
+ * kept as CompressedParticleStates, only the newest one stays in floats. the
+ * combinations decode the older ones block by block (in L1) right before
+ * their fused loop, so evalF and the system state only ever see floats.
+ */
+template <typename T>
+class ExplicitRungeKutta:public TimeStepper
+{
+public:
+  ExplicitRungeKutta(bool compressedStorage = false) : m_compressed(compressedStorage) {}
+
+private:
+  static constexpr int S = T::stages;
+  // floats per block the compressed stages are decoded in.
+  static constexpr int kBlock = 512;
+
+  // coefficients of stage row (row == S: the b weights).
+  static constexpr float coefficient(int row, int j) { return row < S ? T::a[row][j] : T::b[j]; }
+  static constexpr int numTerms(int row)
+  {
+    int n = 0;
+    for (int j = 0; j < (row < S ? row : S); ++j)
+      n += coefficient(row, j) != 0;
+    return n;
+  }
+  template <int Row>
+  static constexpr std::array<int, numTerms(Row)> terms()
+  {
+    std::array<int, numTerms(Row)> t{};
+    int n = 0;
+    for (int j = 0; j < (Row < S ? Row : S); ++j)
+      if (coefficient(Row, j) != 0)
+        t[n++] = j;
+    return t;
+  }
+  static constexpr bool consistent()
+  {
+    for (int row = 0; row < S; ++row)
+    {
+      float sum = 0;
+      for (int j = 0; j < row; ++j)
+        sum += T::a[row][j];
+      float d = sum - T::c[row];
+      if (d > 1e-6f || d < -1e-6f || (row == 0 && T::c[0] != 0))
+        return false;
+    }
+    float sum = 0;
+    for (int j = 0; j < S; ++j)
+      sum += T::b[j];
+    return sum > 1 - 1e-6f && sum < 1 + 1e-6f;
+  }
+  static_assert(consistent(), "explicit tableau needs c_i = sum_j a_ij, c_0 = 0 and weights summing to 1");
+
+  // out = x + h sum_j coefficient(Row, j) k_j
+  template <int Row, std::size_t... J>
+  static void combine(float *out, const float *x, float h, const float *const *k, int n, std::index_sequence<J...>)
+  {
+    constexpr std::array<int, numTerms(Row)> t = terms<Row>();
+    for (int i = 0; i < n; ++i)
+      out[i] = x[i] + h * (... + (coefficient(Row, t[J]) * k[t[J]][i]));
+  }
+  template <int Row>
+  void stage(ParticleSystem *particleSystem, const ParticleState &x, float h, const float *const *k)
+  {
+    if constexpr (Row > 0)
+    {
+      combine<Row>(m_tmp.data(), x.data(), h, k, x.numFloats(), std::make_index_sequence<numTerms(Row)>());
+      particleSystem->evalF(m_tmp, m_k[Row]);
+    }
+    else
+      particleSystem->evalF(x, m_k[0]);
+  }
+  template <std::size_t... Row>
+  void stages(ParticleSystem *particleSystem, const ParticleState &x, float h, const float *const *k, std::index_sequence<Row...>)
+  {
+    (stage<Row>(particleSystem, x, h, k), ...);
+  }
+
+  // combine<Row> with the stages before the newest one decoded from m_stored.
+  template <int Row>
+  void combineCompressed(float *out, const float *x, float h, int n)
+  {
+    constexpr int newest = (Row < S ? Row : S) - 1;
+    const float *k[S] = {};
+    for (int begin = 0; begin < n; begin += kBlock)
+    {
+      const int end = std::min(n, begin + kBlock);
+      for (int j = 0; j < newest; ++j)
+        if (coefficient(Row, j) != 0)
+        {
+          m_stored[j].decodeFloats(begin, end, m_blocks[j]);
+          k[j] = m_blocks[j];
+        }
+      k[newest] = m_k[0].data() + begin;
+      combine<Row>(out + begin, x + begin, h, k, end - begin, std::make_index_sequence<numTerms(Row)>());
+    }
+  }
+  // the newest stage lives in m_k[0], it's compressed once the next one is evaluated.
+  template <int Row>
+  void stageCompressed(ParticleSystem *particleSystem, const ParticleState &x, float h)
+  {
+    if constexpr (Row > 0)
+    {
+      combineCompressed<Row>(m_tmp.data(), x.data(), h, x.numFloats());
+      particleSystem->evalF(m_tmp, m_k[0]);
+    }
+    else
+      particleSystem->evalF(x, m_k[0]);
+    if constexpr (Row < S - 1)
+      m_stored[Row].encode(m_k[0]);
+  }
+  template <std::size_t... Row>
+  void stagesCompressed(ParticleSystem *particleSystem, const ParticleState &x, float h, std::index_sequence<Row...>)
+  {
+    (stageCompressed<Row>(particleSystem, x, h), ...);
+  }
+  void takeStepCompressed(ParticleSystem *particleSystem, float stepSize)
+  {
+    const ParticleState &x = particleSystem->getState();
+    if (m_k[0].size() != x.size())
+      m_k[0].resize(x.size());
+    if (m_tmp.size() != x.size())
+      m_tmp.resize(x.size());
+    stagesCompressed(particleSystem, x, stepSize, std::make_index_sequence<S>());
+    combineCompressed<S>(m_tmp.data(), x.data(), stepSize, x.numFloats());
+    particleSystem->swapState(m_tmp);
+  }
+
+  void takeStep(ParticleSystem* particleSystem, float stepSize)
+  {
+    if (m_compressed)
+    {
+      takeStepCompressed(particleSystem, stepSize);
+      return;
+    }
+    const ParticleState &x = particleSystem->getState();
+    const float *k[S];
+    for (int s = 0; s < S; ++s)
+    {
+      if (m_k[s].size() != x.size())
+        m_k[s].resize(x.size());
+      k[s] = m_k[s].data();
+    }
+    if (m_tmp.size() != x.size())
+      m_tmp.resize(x.size());
+    stages(particleSystem, x, stepSize, k, std::make_index_sequence<S>());
+    combine<S>(m_tmp.data(), x.data(), stepSize, k, x.numFloats(), std::make_index_sequence<numTerms(S)>());
+    particleSystem->swapState(m_tmp);
+  }
+
+  bool m_compressed;
+  ParticleState m_k[S];
+  ParticleState m_tmp;
+  // compressedStorage: the older stages, and the blocks they are decoded into.
+  CompressedParticleState m_stored[S];
+  alignas(32) float m_blocks[S][kBlock];
+};
+
+struct EulerTableau
+{
+  static constexpr int stages = 1;
+  static constexpr float a[1][1] = {{0}};
+  static constexpr float b[1] = {1};
+  static constexpr float c[1] = {0};
+};
+
+// heun's method, the explicit trapezoidal rule.
+struct HeunTableau
+{
+  static constexpr int stages = 2;
+  static constexpr float a[2][2] = {{0, 0}, {1, 0}};
+  static constexpr float b[2] = {0.5f, 0.5f};
+  static constexpr float c[2] = {0, 1};
+};
+
+struct MidpointTableau
+{
+  static constexpr int stages = 2;
+  static constexpr float a[2][2] = {{0, 0}, {0.5f, 0}};
+  static constexpr float b[2] = {0, 1};
+  static constexpr float c[2] = {0, 0.5f};
+};
+
+struct RK4Tableau
+{
+  static constexpr int stages = 4;
+  static constexpr float a[4][4] = {{0, 0, 0, 0}, {0.5f, 0, 0, 0}, {0, 0.5f, 0, 0}, {0, 0, 1, 0}};
+  static constexpr float b[4] = {1 / 6.f, 1 / 3.f, 1 / 3.f, 1 / 6.f};
+  static constexpr float c[4] = {0, 0.5f, 0.5f, 1};
+};
+
+// kutta's 3/8 rule.
+struct ThreeEighthsTableau
+{
+  static constexpr int stages = 4;
+  static constexpr float a[4][4] = {{0, 0, 0, 0}, {1 / 3.f, 0, 0, 0}, {-1 / 3.f, 1, 0, 0}, {1, -1, 1, 0}};
+  static constexpr float b[4] = {1 / 8.f, 3 / 8.f, 3 / 8.f, 1 / 8.f};
+  static constexpr float c[4] = {0, 1 / 3.f, 2 / 3.f, 1};
+};
+
+typedef ExplicitRungeKutta<EulerTableau> ForwardEuler;
+typedef ExplicitRungeKutta<HeunTableau> Trapzoidal;
+typedef ExplicitRungeKutta<MidpointTableau> Midpoint;
+typedef ExplicitRungeKutta<RK4Tableau> RK4;
+typedef ExplicitRungeKutta<ThreeEighthsTableau> ThreeEighths;
+
+// symplectic (semi-implicit) euler: v += h a(x, v), then x += h v.
+// one evalF per step, updates the state in place.
+class SymplecticEuler:public TimeStepper
 {
   void takeStep(ParticleSystem* particleSystem, float stepSize);
+  ParticleState m_f;
+  vector<int> m_constrained;
 };
 
-class Trapzoidal:public TimeStepper
+// velocity verlet, with the drag evaluated at the half step velocity.
+// one evalF per step: the acceleration at the end of a step is kept for the
+// start of the next one, unless the system's stateGeneration moved on since
+// (afterStep corrections, toggles, checkpoint loads, another system).
+class VelocityVerlet:public TimeStepper
 {
   void takeStep(ParticleSystem* particleSystem, float stepSize);
+  ParticleState m_f;
+  vector<int> m_constrained;
+  unsigned long long m_generation = 0;
+};
+
+// position based dynamics, see ClothSystem::stepPositionBased.
+// only steps ClothSystems. fewer iterations are cheaper but stretchier.
+class PositionBasedDynamics:public TimeStepper
+{
+public:
+  PositionBasedDynamics(int iterations = 10) : iterations(iterations) {}
+  int iterations;
+
+private:
+  void takeStep(ParticleSystem* particleSystem, float stepSize);
 };
 
 /////////////////////////
 
-//Provided
-class RK4:public TimeStepper
+/**
+ * @brief linearized backward euler (Baraff & Witkin 98) for ParticleSpringSystems.
+ * solves (M - h df/dv - h^2 df/dx) dv = h (f + h df/dx v) with jacobi
+ * preconditioned CG. df/dx is applied spring by spring from the analytic
+ * spring jacobians, no matrix is ever assembled. constrained particles
+ * (see ParticleSpringSystem::getConstrainedParticles) are filtered out of
+ * the solve and get their prescribed velocity.
+ * the (1 - r/|d|) term of a compressed spring's jacobian is clamped to 0
+ * so the system stays positive definite.
+ */
+class ImplicitEuler:public TimeStepper
 {
+public:
+  ImplicitEuler(int maxIterations = 200, float tolerance = 1e-4f);
+  // CG iterations of the last step.
+  int lastIterations() const { return m_lastIterations; }
+
+private:
+  void takeStep(ParticleSystem* particleSystem, float stepSize);
+  struct SpringJacobian
+  {
+    int p0, p1;
+    float dx, dy, dz; // unit direction p0 -> p1
+    float k;
+    float c;          // max(0, 1 - r/|d|)
+  };
+  // out = A u, with A = (1 + h drag/m) I - (h^2/m) df/dx.
+  void multiplyA(const float *u, float *out);
+  void filter(float *u);
+
+  int m_maxIterations;
+  float m_tolerance;
+  int m_lastIterations = 0;
+  int m_n = 0;
+  float m_diagonal = 1;  // 1 + h drag/m
+  float m_stiffness = 0; // h^2/m
+  ParticleState m_f;
+  ParticleState m_next;
+  vector<SpringRange> m_ranges;
+  vector<int> m_constrained;
+  vector<SpringJacobian> m_jacobians;
+  // CG vectors, x components then y then z.
+  vector<float> m_dv, m_b, m_r, m_c, m_q, m_s, m_precond;
+};
+
+/**
+ * @brief adaptive Dormand-Prince 5(4). each takeStep covers the whole
+ * stepSize (one frame) with as many substeps as the embedded error estimate
+ * allows: a substep is accepted when the rms of
+ * err_i / (absTol + relTol * |x_i|) is at most 1.
+ * the substep size carries over from frame to frame.
+ * if the substep underflows (e.g. once the state went nan) the step stops
+ * at the last accepted substep and failed() turns true.
+ */
+class DormandPrince:public TimeStepper
+{
+public:
+  DormandPrince(float relTol = 1e-3f, float absTol = 1e-4f);
+  // substeps of the last takeStep, and totals over all of them.
+  int lastAccepted() const { return m_lastAccepted; }
+  int lastRejected() const { return m_lastRejected; }
+  long totalAccepted() const { return m_totalAccepted; }
+  long totalRejected() const { return m_totalRejected; }
+  long totalEvaluations() const { return m_totalEvaluations; }
+  bool failed() const override { return m_failed; }
+
+private:
   void takeStep(ParticleSystem* particleSystem, float stepSize);
+  float m_relTol, m_absTol;
+  float m_substep = 0;
+  bool m_failed = false;
+  int m_lastAccepted = 0, m_lastRejected = 0;
+  long m_totalAccepted = 0, m_totalRejected = 0, m_totalEvaluations = 0;
+  ParticleState m_k[7];
+  ParticleState m_next;
 };
 
+/**
+ * @brief makes the stepper picked on the command line:
+ * e - forward euler, t - trapezoidal, m - midpoint, r - rk4, 38 - rk 3/8 rule, i - implicit euler,
+ * d - adaptive dormand-prince, s - symplectic euler, v - velocity verlet,
+ * p - position based dynamics (cloth only).
+ * a trailing c (e.g. rc) keeps the runge-kutta stages compressed, see ExplicitRungeKutta.
+ * prints which one it made unless quiet, throws invalid_argument for anything else.
+ */
+TimeStepper *createTimeStepper(const std::string &solvertype, bool quiet = false);
+
 #endif
@@ -0,0 +1,343 @@
+// Microbenchmarks for the A3 simulation hot paths.
+// build with "make bench", run "./a3bench [maxSide] [minSeconds]".
+// the default CFLAGS have no -O, for numbers worth comparing build from
+// clean with e.g. make bench CFLAGS="-O2 -g -Wall -std=c++17".
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <numeric>
+#include <random>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "../ClothSystem.h"
+#include "../TimeStepper.hpp"
+#include "../springJacobian.h"
+
+using namespace std;
+
+// counting allocator, so every benchmark can report allocations per call.
+namespace
+{
+    long g_numAllocs = 0;
+}
+
+void *operator new(size_t n)
+{
+    ++g_numAllocs;
+    if (void *p = malloc(n ? n : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void *operator new(size_t n, align_val_t alignment)
+{
+    ++g_numAllocs;
+    size_t a = size_t(alignment);
+    if (void *p = aligned_alloc(a, (n + a - 1) / a * a))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { free(p); }
+
+namespace
+{
+    // exposes the protected spring internals of the cloth to the benchmark.
+    class BenchCloth : public ClothSystem
+    {
+    public:
+        BenchCloth(unsigned numParticlesPerSide) : ClothSystem(numParticlesPerSide) {}
+        int numSprings() const { return springs.size(); }
+        // sums up the forces so the calls can't be optimized away.
+        float allSpringForces()
+        {
+            Vector3f sum;
+            for (const Spring &s : springs)
+                sum += springForce(s, m_vVecState);
+            return sum.x() + sum.y() + sum.z();
+        }
+    };
+
+    // uv sphere with 2 * rings * rings triangles.
+    void addSphere(Obstacle &obstacle, const Vector3f &center, float radius, int rings)
+    {
+        auto point = [&](int i, int j)
+        {
+            float theta = M_PI * i / rings, phi = 2 * M_PI * j / rings;
+            return center + radius * Vector3f(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+        };
+        for (int i = 0; i < rings; ++i)
+            for (int j = 0; j < rings; ++j)
+            {
+                obstacle.addTriangle(point(i, j), point(i + 1, j), point(i + 1, j + 1));
+                obstacle.addTriangle(point(i, j), point(i + 1, j + 1), point(i, j + 1));
+            }
+    }
+
+    // the hand written rk4 that replaced libRK4, the baseline the tableau
+    // driven RK4 has to match.
+    class HandWrittenRK4 : public TimeStepper
+    {
+    public:
+        void takeStep(ParticleSystem *particleSystem, float stepSize) override
+        {
+            const ParticleState &oldState = particleSystem->getState();
+            for (ParticleState *s : {&m_k1, &m_k2, &m_k3, &m_k4, &m_tmp})
+                if (s->size() != oldState.size())
+                    s->resize(oldState.size());
+            const int n = oldState.numFloats();
+            const float *x = oldState.data();
+            const float *k1 = m_k1.data(), *k2 = m_k2.data(), *k3 = m_k3.data(), *k4 = m_k4.data();
+            float *t = m_tmp.data();
+            particleSystem->evalF(oldState, m_k1);
+            for (int i = 0; i < n; ++i)
+                t[i] = x[i] + stepSize / 2 * k1[i];
+            particleSystem->evalF(m_tmp, m_k2);
+            for (int i = 0; i < n; ++i)
+                t[i] = x[i] + stepSize / 2 * k2[i];
+            particleSystem->evalF(m_tmp, m_k3);
+            for (int i = 0; i < n; ++i)
+                t[i] = x[i] + stepSize * k3[i];
+            particleSystem->evalF(m_tmp, m_k4);
+            for (int i = 0; i < n; ++i)
+                t[i] = x[i] + stepSize / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+            particleSystem->swapState(m_tmp);
+        }
+
+    private:
+        ParticleState m_k1, m_k2, m_k3, m_k4, m_tmp;
+    };
+
+    // counts the last level cache read misses of this thread, the loads that
+    // had to go to memory. invalid where the kernel doesn't expose the counter
+    // (e.g. in most VMs).
+    class CacheMissCounter
+    {
+    public:
+        CacheMissCounter()
+        {
+#ifdef __linux__
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+        }
+        ~CacheMissCounter()
+        {
+#ifdef __linux__
+            if (m_fd >= 0)
+                close(m_fd);
+#endif
+        }
+        bool valid() const { return m_fd >= 0; }
+        long count() const
+        {
+            long long n = 0;
+#ifdef __linux__
+            if (m_fd < 0 || read(m_fd, &n, sizeof(n)) != sizeof(n))
+                return 0;
+#endif
+            return n;
+        }
+
+    private:
+        int m_fd = -1;
+    };
+
+    volatile float g_sink;
+    double g_minSeconds = 0.2;
+    CacheMissCounter *g_cacheMisses;
+
+    // calls f (after one warm up call) until g_minSeconds have passed and
+    // prints time per call, items (particles or springs) per second, heap
+    // allocations and last level cache read misses per call. returns the time per call in ns.
+    template <typename F>
+    double measure(const char *name, int side, long itemsPerCall, F f)
+    {
+        f();
+        long numCalls = 0;
+        long allocsBefore = g_numAllocs;
+        long missesBefore = g_cacheMisses->count();
+        auto start = chrono::steady_clock::now();
+        double seconds;
+        do
+        {
+            f();
+            ++numCalls;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (seconds < g_minSeconds);
+        double allocsPerCall = double(g_numAllocs - allocsBefore) / numCalls;
+        double missesPerCall = double(g_cacheMisses->count() - missesBefore) / numCalls;
+        printf("%-16s %4dx%-4d %14.1f %14.4g %8.2f", name, side, side,
+               seconds * 1e9 / numCalls, itemsPerCall * numCalls / seconds, allocsPerCall);
+        if (g_cacheMisses->valid())
+            printf(" %12.0f\n", missesPerCall);
+        else
+            printf(" %12s\n", "-");
+        return seconds * 1e9 / numCalls;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int maxSide = argc > 1 ? atoi(argv[1]) : 512;
+    if (argc > 2)
+        g_minSeconds = atof(argv[2]);
+    const float stepSize = 0.01f;
+    CacheMissCounter cacheMisses;
+    g_cacheMisses = &cacheMisses;
+
+    printf("%-16s %9s %14s %14s %8s %12s\n", "benchmark", "cloth", "ns/call", "items/s", "allocs", "llmiss/call");
+    for (int side = 8; side <= maxSide; side *= 2)
+    {
+        BenchCloth cloth(side);
+        ParticleState f(cloth.m_numParticles);
+        cloth.useGridStencil = false;
+        cloth.springForceKernel = addSpringForcesScalar;
+        double rowOrder = measure("evalF scalar", side, cloth.m_numParticles, [&]()
+                                  { cloth.evalF(cloth.getState(), f); });
+        if (cpuHasAvx2())
+        {
+            cloth.springForceKernel = addSpringForcesAvx2;
+            rowOrder = measure("evalF avx2", side, cloth.m_numParticles, [&]()
+                               { cloth.evalF(cloth.getState(), f); });
+        }
+        // the cloth numbered like an irregular mesh (randomly), then put along a morton curve.
+        vector<int> order(cloth.m_numParticles);
+        iota(order.begin(), order.end(), 0);
+        shuffle(order.begin(), order.end(), mt19937(side));
+        BenchCloth shuffled(side), morton(side);
+        shuffled.reorderParticles(order);
+        morton.reorderParticles(order);
+        morton.reorderParticlesMorton();
+        double shuffledOrder = measure("evalF shuffled", side, shuffled.m_numParticles, [&]()
+                                       { shuffled.evalF(shuffled.getState(), f); });
+        double mortonOrder = measure("evalF morton", side, morton.m_numParticles, [&]()
+                                     { morton.evalF(morton.getState(), f); });
+        printf("%-16s %4dx%-4d %13.2fx (%.2fx of row order)\n", "morton speedup", side, side,
+               shuffledOrder / mortonOrder, rowOrder / mortonOrder);
+        cloth.useGridStencil = true;
+        cloth.gridSpringKernel = addGridSpringForcesScalar;
+        measure("evalF grid", side, cloth.m_numParticles, [&]()
+                { cloth.evalF(cloth.getState(), f); });
+        if (cpuHasAvx2())
+        {
+            cloth.gridSpringKernel = addGridSpringForcesAvx2;
+            measure("evalF grid avx2", side, cloth.m_numParticles, [&]()
+                    { cloth.evalF(cloth.getState(), f); });
+        }
+        measure("springForce", side, cloth.numSprings(), [&]()
+                { g_sink = cloth.allSpringForces(); });
+
+        SpringJacobianAssembler jacobian;
+        measure("jacobian", side, cloth.numSprings(), [&]()
+                { jacobian.assemble(cloth, cloth.getState()); });
+        vector<float> u(3 * cloth.m_numParticles, 1.f), dfdxU(u.size());
+        measure("spmv", side, cloth.m_numParticles, [&]()
+                { jacobian.dfdx.multiply(u.data(), dfdxU.data(), cloth.threadPool); });
+        cloth.toggleSelfCollision = true;
+        measure("self collision", side, cloth.m_numParticles, [&]()
+                { cloth.afterStep(stepSize); });
+        cloth.toggleSelfCollision = false;
+
+        // the cloth moving 0.5 down onto a ~100k triangle sphere that pokes through its middle.
+        Obstacle sphere;
+        float radius = side / 3.f;
+        addSphere(sphere, Vector3f(side / 2.f, side / 2.f, -0.8f * radius), radius, 224);
+        sphere.build();
+        ParticleState start = cloth.getState(), previous = start, collided;
+        for (int i = 0; i < previous.size(); ++i)
+            previous.pz()[i] += 0.5f;
+        vector<int> pinned;
+        cloth.getConstrainedParticles(pinned);
+        vector<char> isPinned(cloth.m_numParticles, 0);
+        for (int p : pinned)
+            isPinned[p] = 1;
+        measure("obstacle ccd", side, cloth.m_numParticles, [&]()
+                { collided = start;
+                  g_sink = sphere.collide(collided, previous, isPinned, cloth.threadPool); });
+
+        ForwardEuler euler;
+        Trapzoidal trapezoidal;
+        Midpoint midpoint;
+        RK4 rk4, rk4Compressed(true);
+        HandWrittenRK4 handWrittenRK4;
+        ThreeEighths threeEighths, threeEighthsCompressed(true);
+        ImplicitEuler implicitEuler;
+        DormandPrince dormandPrince;
+        SymplecticEuler symplecticEuler;
+        VelocityVerlet velocityVerlet;
+        PositionBasedDynamics positionBased;
+        struct
+        {
+            const char *name;
+            TimeStepper *stepper;
+        } steppers[] = {{"euler", &euler}, {"trapezoidal", &trapezoidal}, {"midpoint", &midpoint},
+                        {"rk4", &rk4}, {"rk4 compressed", &rk4Compressed}, {"rk4 hand", &handWrittenRK4},
+                        {"rk 3/8", &threeEighths}, {"rk3/8 compressed", &threeEighthsCompressed},
+                        {"implicit euler", &implicitEuler}, {"dormand-prince", &dormandPrince},
+                        {"symplectic euler", &symplecticEuler}, {"velocity verlet", &velocityVerlet},
+                        {"pbd x10", &positionBased}};
+        for (auto &s : steppers)
+        {
+            ClothSystem stepped(side);
+            measure(s.name, side, stepped.m_numParticles, [&]()
+                    { s.stepper->takeStep(&stepped, stepSize); });
+        }
+
+        // how far rk4 with compressed stages drifts from the full precision run.
+        const int accuracySteps = 100;
+        ClothSystem full(side), reduced(side);
+        RK4 fullStepper, reducedStepper(true);
+        for (int i = 0; i < accuracySteps; ++i)
+        {
+            fullStepper.step(&full, stepSize);
+            reducedStepper.step(&reduced, stepSize);
+        }
+        float dx = 0, dv = 0;
+        for (int i = 0; i < full.m_numParticles; ++i)
+        {
+            dx = max(dx, (full.getState().getPosition(i) - reduced.getState().getPosition(i)).abs());
+            dv = max(dv, (full.getState().getVelocity(i) - reduced.getState().getVelocity(i)).abs());
+        }
+        printf("%-16s %4dx%-4d max |dx| %.3g, max |dv| %.3g after %d steps\n", "compressed error", side, side,
+               dx, dv, accuracySteps);
+
+        // the compressed format on its own: one round trip of the moving cloth state.
+        CompressedParticleState compressed;
+        ParticleState roundTrip;
+        measure("state encode", side, full.m_numParticles, [&]()
+                { compressed.encode(full.getState()); });
+        measure("state decode", side, full.m_numParticles, [&]()
+                { compressed.decode(roundTrip); });
+        dx = dv = 0;
+        for (int i = 0; i < full.m_numParticles; ++i)
+        {
+            dx = max(dx, (full.getState().getPosition(i) - roundTrip.getPosition(i)).abs());
+            dv = max(dv, (full.getState().getVelocity(i) - roundTrip.getVelocity(i)).abs() /
+                             max(1.f, full.getState().getVelocity(i).abs()));
+        }
+        printf("%-16s %4dx%-4d %zu of %zu bytes, max |dx| %.3g, max rel |dv| %.3g\n", "state round trip", side, side,
+               compressed.bytes(), full.getState().numFloats() * sizeof(float), dx, dv);
+    }
+    return 0;
+}
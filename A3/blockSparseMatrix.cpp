@@ -0,0 +1,100 @@
+#include "blockSparseMatrix.h"
+#include <algorithm>
+#include <stdexcept>
+
+void BlockSparseMatrix::setPattern(int numRows, const std::vector<std::pair<int, int>> &blocks)
+{
+    std::vector<std::vector<int>> rowCols(numRows);
+    for (int i = 0; i < numRows; ++i)
+        rowCols[i].push_back(i);
+    for (const auto &b : blocks)
+        rowCols[b.first].push_back(b.second);
+
+    rowStart.assign(numRows + 1, 0);
+    colIndex.clear();
+    diagonalBlock.assign(numRows, -1);
+    for (int i = 0; i < numRows; ++i)
+    {
+        std::vector<int> &cols = rowCols[i];
+        std::sort(cols.begin(), cols.end());
+        cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+        for (int c : cols)
+        {
+            if (c == i)
+                diagonalBlock[i] = colIndex.size();
+            colIndex.push_back(c);
+        }
+        rowStart[i + 1] = colIndex.size();
+    }
+    values.assign(9 * colIndex.size(), 0.f);
+}
+
+void BlockSparseMatrix::copyPattern(const BlockSparseMatrix &other)
+{
+    rowStart = other.rowStart;
+    colIndex = other.colIndex;
+    diagonalBlock = other.diagonalBlock;
+    values.assign(other.values.size(), 0.f);
+}
+
+int BlockSparseMatrix::findBlock(int row, int col) const
+{
+    auto first = colIndex.begin() + rowStart[row];
+    auto last = colIndex.begin() + rowStart[row + 1];
+    auto it = std::lower_bound(first, last, col);
+    if (it == last || *it != col)
+        return -1;
+    return it - colIndex.begin();
+}
+
+void BlockSparseMatrix::setZero()
+{
+    std::fill(values.begin(), values.end(), 0.f);
+}
+
+void BlockSparseMatrix::addToDiagonal(float d)
+{
+    for (int b : diagonalBlock)
+    {
+        float *m = block(b);
+        m[0] += d;
+        m[4] += d;
+        m[8] += d;
+    }
+}
+
+void BlockSparseMatrix::addScaled(float a, const BlockSparseMatrix &other)
+{
+    if (other.colIndex != colIndex || other.rowStart != rowStart)
+        throw std::invalid_argument("addScaled: matrices have different patterns.");
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] += a * other.values[i];
+}
+
+void BlockSparseMatrix::multiply(const float *x, float *y, ThreadPool *pool) const
+{
+    const int n = numRows();
+    auto rows = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            float sx = 0, sy = 0, sz = 0;
+            for (int b = rowStart[i]; b < rowStart[i + 1]; ++b)
+            {
+                const float *m = block(b);
+                int j = colIndex[b];
+                float xj = x[j], yj = x[n + j], zj = x[2 * n + j];
+                sx += m[0] * xj + m[1] * yj + m[2] * zj;
+                sy += m[3] * xj + m[4] * yj + m[5] * zj;
+                sz += m[6] * xj + m[7] * yj + m[8] * zj;
+            }
+            y[i] = sx;
+            y[n + i] = sy;
+            y[2 * n + i] = sz;
+        }
+    };
+    if (pool)
+        pool->parallelFor(0, n, rows, 256);
+    else
+        rows(0, n);
+}
@@ -0,0 +1,53 @@
+#ifndef BLOCKSPARSEMATRIX_H
+#define BLOCKSPARSEMATRIX_H
+
+#include <utility>
+#include <vector>
+
+#include "threadPool.h"
+
+/**
+ * @brief square block sparse matrix of 3x3 blocks in BSR (block CSR) form.
+ * block row i couples particle i to the particles in
+ * colIndex[rowStart[i] .. rowStart[i+1]), sorted by column.
+ * every block is 9 row-major floats in values.
+ * vectors it multiplies are laid out like the rest of the solvers:
+ * all x components, then all y, then all z.
+ */
+class BlockSparseMatrix
+{
+public:
+	/**
+	 * @brief sets the sparsity pattern from (row, col) block pairs, duplicates allowed.
+	 * diagonal blocks are always included. values are zeroed.
+	 */
+	void setPattern(int numRows, const std::vector<std::pair<int, int>> &blocks);
+	// same pattern as other, zero values.
+	void copyPattern(const BlockSparseMatrix &other);
+
+	int numRows() const { return (int)rowStart.size() - 1; }
+	int numBlocks() const { return (int)colIndex.size(); }
+	// index of block (row, col), -1 if it isn't in the pattern.
+	int findBlock(int row, int col) const;
+	float *block(int b) { return values.data() + 9 * b; }
+	const float *block(int b) const { return values.data() + 9 * b; }
+
+	void setZero();
+	// adds d to every diagonal entry.
+	void addToDiagonal(float d);
+	// this += a * other, other must have the same pattern.
+	void addScaled(float a, const BlockSparseMatrix &other);
+
+	/**
+	 * @brief y = A x. rows are independent, so they're split across pool
+	 * in pattern order (nullptr runs serially).
+	 */
+	void multiply(const float *x, float *y, ThreadPool *pool = nullptr) const;
+
+	std::vector<int> rowStart;
+	std::vector<int> colIndex;
+	std::vector<int> diagonalBlock; // block index of (i, i)
+	std::vector<float> values;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "bvh.h"
+#include <algorithm>
+
+namespace
+{
+    const int kBins = 16;
+    const int kMaxLeafSize = 4;
+    // the traversal stack holds at most one entry per level plus one.
+    const int kMaxDepth = 60;
+    // cost of visiting a node relative to testing a primitive.
+    const float kTraversalCost = 1.f;
+}
+
+void Bvh::build(const std::vector<Aabb> &boxes)
+{
+    const int n = (int)boxes.size();
+    m_nodes.clear();
+    m_order.resize(n);
+    if (n == 0)
+        return;
+    std::vector<float> centroids(3 * n);
+    for (int i = 0; i < n; ++i)
+    {
+        m_order[i] = i;
+        for (int a = 0; a < 3; ++a)
+            centroids[3 * i + a] = 0.5f * (boxes[i].lo[a] + boxes[i].hi[a]);
+    }
+    m_nodes.reserve(2 * n);
+    Node root;
+    root.first = 0;
+    root.count = n;
+    m_nodes.push_back(root);
+    split(0, boxes, centroids, 0);
+}
+
+void Bvh::split(int nodeIndex, const std::vector<Aabb> &boxes, const std::vector<float> &centroids, int depth)
+{
+    Node node = m_nodes[nodeIndex];
+    Aabb box, centroidBox;
+    for (int i = node.first; i < node.first + node.count; ++i)
+    {
+        box.grow(boxes[m_order[i]]);
+        centroidBox.grow(&centroids[3 * m_order[i]]);
+    }
+    m_nodes[nodeIndex].box = box;
+    if (node.count <= kMaxLeafSize || depth >= kMaxDepth)
+        return;
+
+    // best binned split over all three axes.
+    float bestCost = node.count; // cost of keeping a leaf.
+    int bestAxis = -1, bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float lo = centroidBox.lo[axis], extent = centroidBox.hi[axis] - lo;
+        if (extent <= 0)
+            continue;
+        Aabb binBox[kBins];
+        int binCount[kBins] = {};
+        for (int i = node.first; i < node.first + node.count; ++i)
+        {
+            int b = std::min(kBins - 1, int(kBins * (centroids[3 * m_order[i] + axis] - lo) / extent));
+            binBox[b].grow(boxes[m_order[i]]);
+            ++binCount[b];
+        }
+        // sweep from the right, then from the left.
+        float rightArea[kBins];
+        int rightCount[kBins];
+        Aabb right;
+        int count = 0;
+        for (int b = kBins - 1; b > 0; --b)
+        {
+            right.grow(binBox[b]);
+            count += binCount[b];
+            rightArea[b] = right.area();
+            rightCount[b] = count;
+        }
+        Aabb left;
+        count = 0;
+        for (int b = 0; b < kBins - 1; ++b)
+        {
+            left.grow(binBox[b]);
+            count += binCount[b];
+            if (count == 0 || rightCount[b + 1] == 0)
+                continue;
+            float cost = kTraversalCost + (left.area() * count + rightArea[b + 1] * rightCount[b + 1]) / box.area();
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+    if (bestAxis < 0)
+        return;
+
+    float lo = centroidBox.lo[bestAxis], extent = centroidBox.hi[bestAxis] - lo;
+    int *begin = m_order.data() + node.first;
+    int *mid = std::partition(begin, begin + node.count, [&](int i)
+                              { return std::min(kBins - 1, int(kBins * (centroids[3 * i + bestAxis] - lo) / extent)) <= bestBin; });
+    int leftCount = int(mid - begin);
+
+    int children = (int)m_nodes.size();
+    Node child;
+    child.first = node.first;
+    child.count = leftCount;
+    m_nodes.push_back(child);
+    child.first = node.first + leftCount;
+    child.count = node.count - leftCount;
+    m_nodes.push_back(child);
+    m_nodes[nodeIndex].first = children;
+    m_nodes[nodeIndex].count = 0;
+    split(children, boxes, centroids, depth + 1);
+    split(children + 1, boxes, centroids, depth + 1);
+}
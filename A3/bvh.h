@@ -0,0 +1,95 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+
+struct Aabb
+{
+	float lo[3] = {1e30f, 1e30f, 1e30f};
+	float hi[3] = {-1e30f, -1e30f, -1e30f};
+
+	void grow(const float p[3])
+	{
+		for (int a = 0; a < 3; ++a)
+		{
+			lo[a] = p[a] < lo[a] ? p[a] : lo[a];
+			hi[a] = p[a] > hi[a] ? p[a] : hi[a];
+		}
+	}
+	void grow(const Aabb &b)
+	{
+		for (int a = 0; a < 3; ++a)
+		{
+			lo[a] = b.lo[a] < lo[a] ? b.lo[a] : lo[a];
+			hi[a] = b.hi[a] > hi[a] ? b.hi[a] : hi[a];
+		}
+	}
+	bool overlaps(const Aabb &b) const
+	{
+		return lo[0] <= b.hi[0] && b.lo[0] <= hi[0] &&
+			   lo[1] <= b.hi[1] && b.lo[1] <= hi[1] &&
+			   lo[2] <= b.hi[2] && b.lo[2] <= hi[2];
+	}
+	float area() const
+	{
+		float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+		return dx < 0 ? 0 : 2 * (dx * dy + dy * dz + dz * dx);
+	}
+};
+
+/**
+ * @brief bounding volume hierarchy over a set of boxes, split by the surface
+ * area heuristic (binned, 16 bins per axis). the tree is immutable once
+ * built, so any number of threads can query it at the same time.
+ */
+class Bvh
+{
+public:
+	struct Node
+	{
+		Aabb box;
+		// leaf: primitives order[first, first + count). inner: children first, first + 1.
+		int first;
+		int count;
+	};
+
+	void build(const std::vector<Aabb> &boxes);
+
+	/**
+	 * @brief calls visit(primitive) for every primitive whose box overlaps box.
+	 */
+	template <typename F>
+	void query(const Aabb &box, F &&visit) const
+	{
+		if (m_nodes.empty())
+			return;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node &node = m_nodes[stack[--top]];
+			if (!node.box.overlaps(box))
+				continue;
+			if (node.count > 0)
+			{
+				for (int i = node.first; i < node.first + node.count; ++i)
+					visit(m_order[i]);
+			}
+			else
+			{
+				stack[top++] = node.first;
+				stack[top++] = node.first + 1;
+			}
+		}
+	}
+
+	const std::vector<Node> &nodes() const { return m_nodes; }
+
+private:
+	void split(int node, const std::vector<Aabb> &boxes, const std::vector<float> &centroids, int depth);
+	std::vector<Node> m_nodes;
+	std::vector<int> m_order;
+};
+
+#endif
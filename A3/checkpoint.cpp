@@ -0,0 +1,188 @@
+#include "checkpoint.h"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace checkpoint
+{
+    namespace
+    {
+        const char kMagic[4] = {'A', '3', 'C', 'K'};
+        const uint32_t kByteOrder = 0x01020304;
+        const size_t kAlignment = 32;
+
+        struct Header
+        {
+            char magic[4];
+            uint32_t byteOrder;
+            uint32_t version;
+            uint32_t numSections;
+        };
+
+        struct SectionEntry
+        {
+            uint32_t tag;
+            uint32_t reserved;
+            uint64_t offset;
+            uint64_t bytes;
+        };
+
+        size_t align(size_t offset)
+        {
+            return (offset + kAlignment - 1) / kAlignment * kAlignment;
+        }
+    }
+
+    void Writer::add(uint32_t tag, const void *data, size_t bytes)
+    {
+        m_sections.push_back({tag, data, bytes, {}});
+    }
+
+    void Writer::addCopy(uint32_t tag, const void *data, size_t bytes)
+    {
+        const char *begin = static_cast<const char *>(data);
+        m_sections.push_back({tag, nullptr, bytes, std::vector<char>(begin, begin + bytes)});
+    }
+
+    void Writer::write(const std::string &fileName) const
+    {
+        Header header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.byteOrder = kByteOrder;
+        header.version = kVersion;
+        header.numSections = m_sections.size();
+        std::vector<SectionEntry> table(m_sections.size());
+        size_t offset = align(sizeof(Header) + table.size() * sizeof(SectionEntry));
+        for (size_t i = 0; i < m_sections.size(); ++i)
+        {
+            table[i] = {m_sections[i].tag, 0, offset, m_sections[i].bytes};
+            offset = align(offset + m_sections[i].bytes);
+        }
+
+        // written next to the target and renamed over it once it's on disk,
+        // so a crash or a full disk never leaves a half written checkpoint.
+        const std::string tmpName = fileName + ".tmp";
+        int fd = open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("can't open " + tmpName);
+        bool ok = true;
+        auto put = [&](const void *data, size_t bytes)
+        {
+            const char *begin = static_cast<const char *>(data);
+            while (ok && bytes > 0)
+            {
+                ssize_t n = ::write(fd, begin, bytes);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                ok = n > 0;
+                begin += ok ? n : 0;
+                bytes -= ok ? n : 0;
+            }
+        };
+        const char padding[kAlignment] = {};
+        put(&header, sizeof(header));
+        put(table.data(), table.size() * sizeof(SectionEntry));
+        size_t written = sizeof(Header) + table.size() * sizeof(SectionEntry);
+        for (size_t i = 0; i < m_sections.size(); ++i)
+        {
+            put(padding, table[i].offset - written);
+            const Section &section = m_sections[i];
+            put(section.data ? section.data : section.copy.data(), section.bytes);
+            written = table[i].offset + m_sections[i].bytes;
+        }
+        put(padding, align(written) - written);
+        ok = ok && fsync(fd) == 0;
+        ok = close(fd) == 0 && ok;
+        if (!ok || rename(tmpName.c_str(), fileName.c_str()) != 0)
+        {
+            unlink(tmpName.c_str());
+            throw std::runtime_error("can't write " + fileName);
+        }
+    }
+
+    Reader::Reader(const std::string &fileName) : m_fileName(fileName)
+    {
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("can't open " + fileName);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header))
+        {
+            close(fd);
+            throw std::runtime_error(fileName + " is not a checkpoint");
+        }
+        m_size = info.st_size;
+        void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("can't map " + fileName);
+        m_data = static_cast<const char *>(data);
+
+        Header header;
+        std::memcpy(&header, m_data, sizeof(header));
+        std::string error;
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+            error = " is not a checkpoint";
+        else if (header.byteOrder != kByteOrder)
+            error = " was written with another byte order";
+        else if (header.version == 0 || header.version > kVersion)
+            error = " has unsupported version " + std::to_string(header.version);
+        else if (sizeof(Header) + size_t(header.numSections) * sizeof(SectionEntry) > m_size)
+            error = " is truncated";
+        else
+        {
+            const char *table = m_data + sizeof(Header);
+            for (uint32_t i = 0; i < header.numSections; ++i)
+            {
+                SectionEntry entry;
+                std::memcpy(&entry, table + i * sizeof(SectionEntry), sizeof(entry));
+                if (entry.offset > m_size || entry.bytes > m_size - entry.offset)
+                    error = " is truncated";
+            }
+        }
+        if (!error.empty())
+        {
+            munmap(const_cast<char *>(m_data), m_size);
+            throw std::runtime_error(fileName + error);
+        }
+        m_version = header.version;
+    }
+
+    Reader::~Reader()
+    {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+
+    const void *Reader::find(uint32_t tag, size_t &bytes) const
+    {
+        Header header;
+        std::memcpy(&header, m_data, sizeof(header));
+        const char *table = m_data + sizeof(Header);
+        for (uint32_t i = 0; i < header.numSections; ++i)
+        {
+            SectionEntry entry;
+            std::memcpy(&entry, table + i * sizeof(SectionEntry), sizeof(entry));
+            if (entry.tag == tag)
+            {
+                bytes = entry.bytes;
+                return m_data + entry.offset;
+            }
+        }
+        bytes = 0;
+        return nullptr;
+    }
+
+    const void *Reader::require(uint32_t tag, size_t &bytes) const
+    {
+        const void *data = find(tag, bytes);
+        if (!data)
+        {
+            char name[5] = {char(tag), char(tag >> 8), char(tag >> 16), char(tag >> 24), 0};
+            throw std::runtime_error(m_fileName + " has no " + name + " section");
+        }
+        return data;
+    }
+}
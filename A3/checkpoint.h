@@ -0,0 +1,104 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief versioned binary checkpoint files.
+ * a file is a header, a table of sections and the sections themselves,
+ * each section a tagged blob of plain data starting on a 32 byte boundary.
+ * numbers are stored in the byte order of the machine that wrote them, a
+ * file from a machine with the other byte order is rejected.
+ * the reader maps the whole file with one mmap and copies every section out
+ * in one piece, nothing is parsed element by element.
+ */
+namespace checkpoint
+{
+	const uint32_t kVersion = 1;
+
+	constexpr uint32_t tag(const char (&name)[5])
+	{
+		return uint32_t(name[0]) | uint32_t(name[1]) << 8 | uint32_t(name[2]) << 16 | uint32_t(name[3]) << 24;
+	}
+
+	class Writer
+	{
+	public:
+		// the data isn't copied, it has to stay alive until write().
+		void add(uint32_t tag, const void *data, size_t bytes);
+		template <typename T>
+		void add(uint32_t tag, const std::vector<T> &values)
+		{
+			add(tag, values.data(), values.size() * sizeof(T));
+		}
+		// for temporaries, copies the data.
+		void addCopy(uint32_t tag, const void *data, size_t bytes);
+		template <typename T>
+		void addValue(uint32_t tag, const T &value)
+		{
+			addCopy(tag, &value, sizeof(T));
+		}
+		// replaces fileName in one piece (through fileName + ".tmp"), throws
+		// runtime_error and leaves an existing file alone if it can't.
+		void write(const std::string &fileName) const;
+
+	private:
+		struct Section
+		{
+			uint32_t tag;
+			const void *data;
+			size_t bytes;
+			std::vector<char> copy; // holds the data if it was copied.
+		};
+		std::vector<Section> m_sections;
+	};
+
+	class Reader
+	{
+	public:
+		// maps fileName, throws runtime_error if it isn't a checkpoint this version can read.
+		Reader(const std::string &fileName);
+		~Reader();
+		Reader(const Reader &) = delete;
+		Reader &operator=(const Reader &) = delete;
+
+		uint32_t version() const { return m_version; }
+		// the section tagged tag, nullptr if there is none.
+		const void *find(uint32_t tag, size_t &bytes) const;
+		// copies a section of Ts into values, throws runtime_error if it's missing.
+		template <typename T>
+		void read(uint32_t tag, std::vector<T> &values) const
+		{
+			size_t bytes;
+			const void *data = require(tag, bytes);
+			if (bytes % sizeof(T) != 0)
+				throw std::runtime_error(m_fileName + ": section has the wrong size");
+			values.resize(bytes / sizeof(T));
+			if (bytes > 0)
+				std::memcpy(values.data(), data, bytes);
+		}
+		template <typename T>
+		void readValue(uint32_t tag, T &value) const
+		{
+			size_t bytes;
+			const void *data = require(tag, bytes);
+			if (bytes != sizeof(T))
+				throw std::runtime_error(m_fileName + ": section has the wrong size");
+			std::memcpy(&value, data, bytes);
+		}
+		const void *require(uint32_t tag, size_t &bytes) const;
+
+	private:
+		std::string m_fileName;
+		const char *m_data = nullptr;
+		size_t m_size = 0;
+		uint32_t m_version = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,55 @@
+#include "compressedState.h"
+#include <algorithm>
+
+#include "halfFloat.h"
+
+void CompressedParticleState::encode(const ParticleState &state)
+{
+    const int n = state.size();
+    const int stride = state.stride();
+    if (m_stride != stride)
+    {
+        m_positions.resize(3 * stride);
+        m_velocities.resize(3 * stride);
+        m_stride = stride;
+    }
+    m_numParticles = n;
+    for (int c = 0; c < 3; ++c)
+    {
+        const float *p = state.data() + c * stride;
+        double sum = 0;
+        for (int i = 0; i < n; ++i)
+            sum += p[i];
+        const float origin = n > 0 ? float(sum / n) : 0.f;
+        m_origin[c] = origin;
+        float *offset = m_positions.data() + c * stride;
+        for (int i = 0; i < stride; ++i)
+            offset[i] = p[i] - origin;
+    }
+    floatsToHalves(state.data() + 3 * stride, m_velocities.data(), 3 * stride);
+}
+
+void CompressedParticleState::decode(ParticleState &state) const
+{
+    if (state.size() != m_numParticles)
+        state.resize(m_numParticles);
+    decodeFloats(0, numFloats(), state.data());
+}
+
+void CompressedParticleState::decodeFloats(int begin, int end, float *out) const
+{
+    // position components one at a time, each has its own origin.
+    while (begin < end && begin < 3 * m_stride)
+    {
+        const int c = begin / m_stride;
+        const int stop = std::min(end, (c + 1) * m_stride);
+        const float origin = m_origin[c];
+        const float *offset = m_positions.data() + begin;
+        for (int i = 0; i < stop - begin; ++i)
+            out[i] = origin + offset[i];
+        out += stop - begin;
+        begin = stop;
+    }
+    if (begin < end)
+        halvesToFloats(m_velocities.data() + begin - 3 * m_stride, out, end - begin);
+}
@@ -0,0 +1,45 @@
+#ifndef COMPRESSEDSTATE_H
+#define COMPRESSEDSTATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "particleState.h"
+
+/**
+ * @brief a ParticleState, or the derivative of one, in 18 instead of 24 bytes
+ * per particle: the position slots as float32 offsets from a frame origin
+ * (their mean when encoded), the velocity slots as ieee halves (relative
+ * error at most 2^-11, see halfFloat.h).
+ * encoding and decoding run 8 floats at a time, with F16C where the cpu has
+ * it. decodeFloats decodes any piece of the flat layout of ParticleState::data,
+ * so a time stepper can decode block by block inside its own loops and never
+ * needs a float copy of the whole state.
+ */
+class CompressedParticleState
+{
+public:
+	void encode(const ParticleState &state);
+	void decode(ParticleState &state) const;
+	// floats [begin, end) of the flat layout into out.
+	void decodeFloats(int begin, int end, float *out) const;
+
+	int size() const { return m_numParticles; }
+	int numFloats() const { return 6 * m_stride; }
+	// heap bytes, padding included.
+	size_t bytes() const
+	{
+		return m_positions.size() * sizeof(float) + m_velocities.size() * sizeof(uint16_t);
+	}
+
+private:
+	int m_numParticles = 0;
+	int m_stride = 0;
+	float m_origin[3] = {};
+	// px, py, pz offsets from m_origin, then vx, vy, vz as halves, each stride long.
+	std::vector<float, AlignedAllocator<float>> m_positions;
+	std::vector<uint16_t, AlignedAllocator<uint16_t>> m_velocities;
+};
+
+#endif
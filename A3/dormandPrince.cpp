@@ -0,0 +1,114 @@
+#include "TimeStepper.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Dormand & Prince 1980. the last row of a is the 5th order solution,
+    // e is the difference to the embedded 4th order one.
+    const double a[7][6] = {
+        {0, 0, 0, 0, 0, 0},
+        {1.0 / 5, 0, 0, 0, 0, 0},
+        {3.0 / 40, 9.0 / 40, 0, 0, 0, 0},
+        {44.0 / 45, -56.0 / 15, 32.0 / 9, 0, 0, 0},
+        {19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729, 0, 0},
+        {9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656, 0},
+        {35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84}};
+    const double e[7] = {71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40};
+
+    const float safety = 0.9f;
+    const float minScale = 0.2f;
+    const float maxScale = 5.0f;
+}
+
+DormandPrince::DormandPrince(float relTol, float absTol) : m_relTol(relTol), m_absTol(absTol)
+{
+}
+
+void DormandPrince::takeStep(ParticleSystem *particleSystem, float stepSize)
+{
+    if (m_failed)
+        return;
+    const int numParticles = particleSystem->getState().size();
+    if (m_next.size() != numParticles)
+    {
+        m_next.resize(numParticles);
+        for (ParticleState &k : m_k)
+            k.resize(numParticles);
+    }
+    const int n = m_next.numFloats();
+    if (m_substep <= 0 || m_substep > stepSize)
+        m_substep = stepSize;
+
+    m_lastAccepted = m_lastRejected = 0;
+    particleSystem->evalF(particleSystem->getState(), m_k[0]);
+    ++m_totalEvaluations;
+    float t = 0;
+    bool done = false;
+    while (!done)
+    {
+        // don't leave a sliver at the end of the frame.
+        float h = m_substep;
+        bool lastSubstep = t + h >= stepSize * (1 - 1e-5f);
+        if (lastSubstep)
+            h = stepSize - t;
+        if (h <= stepSize * 1e-7f)
+        {
+            // no step size is accurate enough, give up on this system.
+            m_failed = true;
+            break;
+        }
+
+        const float *x = particleSystem->getState().data();
+        float *next = m_next.data();
+        for (int s = 1; s < 7; ++s)
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                double sum = 0;
+                for (int j = 0; j < s; ++j)
+                    sum += a[s][j] * m_k[j].data()[i];
+                next[i] = x[i] + h * float(sum);
+            }
+            // the stage 7 input is the 5th order solution, its derivative is
+            // the first stage of the next substep (FSAL).
+            particleSystem->evalF(m_next, m_k[s]);
+            ++m_totalEvaluations;
+        }
+
+        double errSquared = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            double err = 0;
+            for (int j = 0; j < 7; ++j)
+                err += e[j] * m_k[j].data()[i];
+            double scale = m_absTol + m_relTol * max(fabs(x[i]), fabs(next[i]));
+            errSquared += (h * err / scale) * (h * err / scale);
+        }
+        float err = sqrt(errSquared / (6 * numParticles));
+        if (!std::isfinite(err))
+            err = 1e10f;
+
+        float factor = err > 0 ? safety * pow(err, -0.2f) : maxScale;
+        factor = min(maxScale, max(minScale, factor));
+        if (err <= 1)
+        {
+            particleSystem->swapState(m_next);
+            swap(m_k[0], m_k[6]);
+            t += h;
+            done = lastSubstep;
+            ++m_lastAccepted;
+            // a last substep cut short says little about the next frame.
+            if (!lastSubstep || h >= m_substep)
+                m_substep = h * factor;
+        }
+        else
+        {
+            m_substep = h * factor;
+            ++m_lastRejected;
+        }
+    }
+    m_totalAccepted += m_lastAccepted;
+    m_totalRejected += m_lastRejected;
+}
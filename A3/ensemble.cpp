@@ -0,0 +1,130 @@
+#include "ensemble.h"
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+#include "ClothSystem.h"
+#include "TimeStepper.hpp"
+
+namespace
+{
+    struct Energy
+    {
+        double kinetic, total;
+    };
+
+    Energy energy(const ParticleSpringSystem &system, const ParticleState &state)
+    {
+        const float m = system.getParticleMass(), g = system.getGravity();
+        const float *px = state.px(), *py = state.py(), *pz = state.pz();
+        const float *vx = state.vx(), *vy = state.vy(), *vz = state.vz();
+        double kinetic = 0, potential = 0;
+        for (int i = 0; i < state.size(); ++i)
+        {
+            kinetic += 0.5 * m * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+            potential += m * g * py[i];
+        }
+        for (const Spring &s : system.getSprings())
+        {
+            float dx = px[s.p1] - px[s.p0], dy = py[s.p1] - py[s.p0], dz = pz[s.p1] - pz[s.p0];
+            double stretch = std::sqrt(dx * dx + dy * dy + dz * dz) - s.r;
+            potential += 0.5 * s.k * stretch * stretch;
+        }
+        return Energy{kinetic, kinetic + potential};
+    }
+
+    uint64_t hashState(const ParticleState &state)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        const float *arrays[6] = {state.px(), state.py(), state.pz(), state.vx(), state.vy(), state.vz()};
+        for (const float *a : arrays)
+        {
+            const unsigned char *bytes = reinterpret_cast<const unsigned char *>(a);
+            for (size_t i = 0; i < state.size() * sizeof(float); ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void run(ClothSystem &cloth, TimeStepper &stepper, const EnsembleOptions &options, EnsembleResult &result)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const float h = result.parameters.stepSize;
+        const ParticleState &state = cloth.getState();
+        // what the cloth can give up by falling to its lowest particle.
+        float lowest = state.py()[0];
+        for (int i = 0; i < state.size(); ++i)
+            lowest = std::min(lowest, state.py()[i]);
+        double available = 0;
+        for (int i = 0; i < state.size(); ++i)
+            available += cloth.getParticleMass() * cloth.getGravity() * (state.py()[i] - lowest);
+        const double initialEnergy = energy(cloth, state).total;
+        const double settledKinetic = options.settleFraction * available;
+
+        const int numSteps = int(std::ceil(options.duration / h));
+        float lastMoving = 0;
+        int step = 0;
+        while (step < numSteps)
+        {
+            stepper.step(&cloth, h);
+            ++step;
+            if (stepper.failed())
+            {
+                result.status = "stepper";
+                result.failTime = step * h;
+                break;
+            }
+            if (step % options.checkEvery != 0 && step != numSteps)
+                continue;
+            Energy e = energy(cloth, state);
+            float t = step * h;
+            if (!std::isfinite(e.total))
+            {
+                result.status = "nan";
+                result.failTime = t;
+                break;
+            }
+            if (e.total - initialEnergy > available)
+            {
+                result.status = "energy";
+                result.failTime = t;
+                break;
+            }
+            if (e.kinetic >= settledKinetic)
+                lastMoving = t;
+        }
+        if (result.failTime < 0 && lastMoving < step * h)
+            result.settleTime = lastMoving;
+        result.steps = step;
+        result.stateHash = hashState(state);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+std::vector<EnsembleResult> runEnsemble(const std::vector<EnsembleParameters> &parameterSets,
+                                        const EnsembleOptions &options, ThreadPool &pool)
+{
+    const int numRuns = parameterSets.size();
+    // built up front on this thread, createTimeStepper can throw.
+    std::vector<std::unique_ptr<ClothSystem>> cloths(numRuns);
+    std::vector<std::unique_ptr<TimeStepper>> steppers(numRuns);
+    std::vector<EnsembleResult> results(numRuns);
+    for (int i = 0; i < numRuns; ++i)
+    {
+        const EnsembleParameters &p = parameterSets[i];
+        cloths[i].reset(new ClothSystem(options.numParticlesPerSide));
+        cloths[i]->threadPool = nullptr;
+        cloths[i]->setSpringStiffness(p.k);
+        cloths[i]->setDrag(p.drag);
+        cloths[i]->setParticleMass(p.particleMass);
+        steppers[i].reset(createTimeStepper(options.stepper, true));
+        results[i].parameters = p;
+    }
+    // one run per task.
+    pool.parallelFor(0, numRuns, [&](int begin, int end)
+                     {
+                         for (int i = begin; i < end; ++i)
+                             run(*cloths[i], *steppers[i], options, results[i]); },
+                     1);
+    return results;
+}
@@ -0,0 +1,58 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "threadPool.h"
+
+struct EnsembleParameters
+{
+	float k = 1.f;
+	float drag = 0.5f;
+	float particleMass = 0.05f;
+	float stepSize = 0.01f;
+};
+
+struct EnsembleOptions
+{
+	int numParticlesPerSide = 16;
+	std::string stepper = "r";
+	// simulated seconds per run.
+	float duration = 20.f;
+	// energy is checked every this many steps.
+	int checkEvery = 10;
+	// settled once the kinetic energy stays below this fraction of the
+	// potential energy the cloth can give up by falling (see EnsembleResult).
+	float settleFraction = 1e-4f;
+};
+
+struct EnsembleResult
+{
+	EnsembleParameters parameters;
+	// "stable", "nan", "energy": the total energy grew by more than the
+	// potential energy the cloth had to lose at the start, which only an
+	// unstable step can do with still anchors, or "stepper": the time
+	// stepper gave up (see TimeStepper::failed).
+	std::string status = "stable";
+	// simulated time the run failed at, -1 if it didn't.
+	float failTime = -1;
+	// simulated time from which on the cloth stayed settled, -1 if it never did.
+	float settleTime = -1;
+	// fnv-1a of the final positions and velocities.
+	uint64_t stateHash = 0;
+	int steps = 0;
+	double seconds = 0;
+};
+
+/**
+ * @brief runs one ClothSystem per parameter set, the sets spread over pool.
+ * every run owns its cloth and stepper and steps them serially (its cloth
+ * gets no thread pool), so runs share nothing and results don't depend on
+ * how they were scheduled.
+ */
+std::vector<EnsembleResult> runEnsemble(const std::vector<EnsembleParameters> &parameterSets,
+										const EnsembleOptions &options, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,54 @@
+#include "fixedStepLoop.h"
+#include <cmath>
+#include <iostream>
+
+FixedStepLoop::FixedStepLoop(ParticleSystem *system, TimeStepper *timeStepper,
+                             float stepSize, float timeScale, int maxSubsteps)
+    : m_system(system), m_timeStepper(timeStepper), m_stepSize(stepSize),
+      m_timeScale(timeScale), m_maxSubsteps(maxSubsteps)
+{
+    m_previous = system->getState();
+}
+
+int FixedStepLoop::advance(double wallSeconds)
+{
+    m_accumulator += wallSeconds * m_timeScale;
+    int steps = 0;
+    while (m_accumulator >= m_stepSize && steps < m_maxSubsteps)
+    {
+        // a failed stepper doesn't step any more, the time just passes.
+        if (m_timeStepper->failed())
+        {
+            m_accumulator = 0;
+            break;
+        }
+        m_previous = m_system->getState();
+        m_timeStepper->step(m_system, m_stepSize);
+        m_accumulator -= m_stepSize;
+        ++steps;
+        if (m_timeStepper->failed())
+            std::cerr << "the time stepper failed, stopped stepping." << std::endl;
+    }
+    if (m_accumulator >= m_stepSize)
+    {
+        // over budget, drop whole steps but keep the phase.
+        m_accumulator = std::fmod(m_accumulator, double(m_stepSize));
+        ++m_droppedFrames;
+    }
+    return steps;
+}
+
+const ParticleState &FixedStepLoop::interpolated()
+{
+    const ParticleState &current = m_system->getState();
+    if (m_previous.size() != current.size())
+        return current;
+    if (m_interpolated.size() != current.size())
+        m_interpolated.resize(current.size());
+    const float a = alpha();
+    const float *p = m_previous.data(), *c = current.data();
+    float *out = m_interpolated.data();
+    for (int i = 0; i < current.numFloats(); ++i)
+        out[i] = p[i] + a * (c[i] - p[i]);
+    return m_interpolated;
+}
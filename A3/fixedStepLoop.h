@@ -0,0 +1,47 @@
+#ifndef FIXEDSTEPLOOP_H
+#define FIXEDSTEPLOOP_H
+
+#include "particleSystem.h"
+#include "TimeStepper.hpp"
+
+/**
+ * @brief frame driven stepping with a fixed step size: advance() turns the
+ * wall clock time since the last frame into as many steps as it covers,
+ * the remainder is carried over to the next frame. interpolated() blends
+ * the last two states by that remainder, so the motion on screen is smooth
+ * even when a frame covers a fractional number of steps.
+ * at most maxSubsteps run per frame, time beyond that is dropped (the
+ * simulation runs slower than real time) instead of piling up.
+ */
+class FixedStepLoop
+{
+public:
+	/**
+	 * @param timeScale simulated seconds per wall clock second.
+	 */
+	FixedStepLoop(ParticleSystem *system, TimeStepper *timeStepper,
+				  float stepSize, float timeScale = 1, int maxSubsteps = 32);
+
+	// runs the steps wallSeconds cover, returns how many.
+	int advance(double wallSeconds);
+	// fraction of a step carried over, in [0, 1).
+	float alpha() const { return m_accumulator / m_stepSize; }
+	// (1 - alpha) previous state + alpha current state.
+	const ParticleState &interpolated();
+	// frames that hit maxSubsteps.
+	long droppedFrames() const { return m_droppedFrames; }
+
+private:
+	ParticleSystem *m_system;
+	TimeStepper *m_timeStepper;
+	float m_stepSize;
+	float m_timeScale;
+	int m_maxSubsteps;
+	// simulated time not stepped yet.
+	double m_accumulator = 0;
+	long m_droppedFrames = 0;
+	ParticleState m_previous;
+	ParticleState m_interpolated;
+};
+
+#endif
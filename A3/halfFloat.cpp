@@ -0,0 +1,130 @@
+#include "halfFloat.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+uint16_t floatToHalf(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint16_t sign = (x >> 16) & 0x8000;
+    const uint32_t abs = x & 0x7fffffff;
+    // nan (kept quiet, with the top of its payload) or infinity.
+    if (abs >= 0x7f800000)
+        return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0);
+    // 65520 and up round to infinity.
+    if (abs >= 0x477ff000)
+        return sign | 0x7c00;
+    // up to 2^-25 rounds to 0.
+    if (abs <= 0x33000000)
+        return sign;
+    uint32_t half, rest, halfway;
+    if (abs < 0x38800000)
+    {
+        // below 2^-14 the half is subnormal, a multiple of 2^-24.
+        const uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        const int shift = 126 - int(abs >> 23);
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        // rebias the exponent from 127 to 15 and drop 13 mantissa bits.
+        half = (abs - 0x38000000) >> 13;
+        rest = abs & 0x1fff;
+        halfway = 0x1000;
+    }
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half;
+    return sign | half;
+}
+
+float halfToFloat(uint16_t h)
+{
+    const uint32_t sign = uint32_t(h & 0x8000) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1f;
+    const uint32_t mantissa = h & 0x3ff;
+    uint32_t x;
+    if (exponent == 0x1f)
+        x = sign | 0x7f800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+    else if (exponent == 0)
+    {
+        // 0 or subnormal, exact as a float.
+        float f = mantissa * (1.f / (1 << 24));
+        memcpy(&x, &f, sizeof(x));
+        x |= sign;
+    }
+    else
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+namespace
+{
+    __attribute__((target("avx,f16c"))) void floatsToHalvesF16c(const float *in, uint16_t *out, int n)
+    {
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                             _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+        for (; i < n; ++i)
+            out[i] = floatToHalf(in[i]);
+    }
+
+    __attribute__((target("avx,f16c"))) void halvesToFloatsF16c(const uint16_t *in, float *out, int n)
+    {
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))));
+        for (; i < n; ++i)
+            out[i] = halfToFloat(in[i]);
+    }
+}
+
+bool cpuHasF16c()
+{
+    return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+}
+
+#else
+
+namespace
+{
+    void floatsToHalvesF16c(const float *in, uint16_t *out, int n) {}
+    void halvesToFloatsF16c(const uint16_t *in, float *out, int n) {}
+}
+
+bool cpuHasF16c()
+{
+    return false;
+}
+
+#endif
+
+void floatsToHalves(const float *in, uint16_t *out, int n)
+{
+    static const bool f16c = cpuHasF16c();
+    if (f16c)
+        floatsToHalvesF16c(in, out, n);
+    else
+        for (int i = 0; i < n; ++i)
+            out[i] = floatToHalf(in[i]);
+}
+
+void halvesToFloats(const uint16_t *in, float *out, int n)
+{
+    static const bool f16c = cpuHasF16c();
+    if (f16c)
+        halvesToFloatsF16c(in, out, n);
+    else
+        for (int i = 0; i < n; ++i)
+            out[i] = halfToFloat(in[i]);
+}
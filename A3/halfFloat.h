@@ -0,0 +1,20 @@
+#ifndef HALFFLOAT_H
+#define HALFFLOAT_H
+
+#include <cstdint>
+
+/**
+ * @brief ieee binary16 (half precision) conversion, rounding to nearest even.
+ * a half keeps 11 significant bits (relative error at most 2^-11) and
+ * magnitudes up to 65504, larger ones become infinity.
+ * the array versions convert 8 values at a time with F16C where the cpu has
+ * it, with the same results as the scalar ones.
+ */
+uint16_t floatToHalf(float f);
+float halfToFloat(uint16_t h);
+void floatsToHalves(const float *in, uint16_t *out, int n);
+void halvesToFloats(const uint16_t *in, float *out, int n);
+
+bool cpuHasF16c();
+
+#endif
@@ -0,0 +1,181 @@
+#include "headless.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "TimeStepper.hpp"
+#include "trajectory.h"
+#include "pendulumSystem.h"
+#include "ClothSystem.h"
+
+using namespace std;
+
+namespace
+{
+    void writeState(ostream &out, const ParticleState &state)
+    {
+        out.precision(9);
+        for (int i = 0; i < state.size(); ++i)
+        {
+            Vector3f p = state.getPosition(i);
+            Vector3f v = state.getVelocity(i);
+            out << p.x() << " " << p.y() << " " << p.z() << " "
+                << v.x() << " " << v.y() << " " << v.z() << "\n";
+        }
+    }
+
+    void printUsage(const char *program)
+    {
+        cerr << "usage: " << program << " headless <c|p> <size|checkpoint> <stepper> <stepsize> <numSteps> [outFile] [checkpointOut] [trajectoryOut [everyN]]" << endl;
+    }
+}
+
+int runHeadless(int argc, char *argv[])
+{
+    if (argc < 7)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    string systemType = argv[2];
+    // a size that isn't a number is a checkpoint to restart from.
+    char *sizeEnd;
+    int size = strtol(argv[3], &sizeEnd, 10);
+    bool restart = *sizeEnd != 0;
+    char *stepsizeEnd, *numStepsEnd;
+    float stepsize = strtof(argv[5], &stepsizeEnd);
+    long numSteps = strtol(argv[6], &numStepsEnd, 10);
+    if ((!restart && size <= 0) || *stepsizeEnd != 0 || !(stepsize > 0) || *numStepsEnd != 0 || numSteps <= 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // when restarting, a small system of the right kind is replaced by the checkpoint.
+    unique_ptr<ParticleSystem> system;
+    if (systemType == "c")
+        system.reset(new ClothSystem(restart ? 2 : size));
+    else if (systemType == "p")
+        system.reset(new PendulumSystem(restart ? 2 : size));
+    else
+    {
+        cerr << "can only choose c - cloth or p - pendulum." << endl;
+        return 1;
+    }
+    if (restart)
+    {
+        try
+        {
+            system->loadCheckpoint(argv[3]);
+        }
+        catch (const exception &e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        cout << "restarted from " << argv[3] << endl;
+    }
+    unique_ptr<TimeStepper> timeStepper;
+    try
+    {
+        timeStepper.reset(createTimeStepper(argv[4]));
+    }
+    catch (const invalid_argument &e)
+    {
+        cerr << e.what() << endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    unique_ptr<TrajectoryRecorder> recorder;
+    if (argc > 9)
+    {
+        try
+        {
+            recorder.reset(new TrajectoryRecorder(argv[9], system->m_numParticles,
+                                                  argc > 10 ? atoi(argv[10]) : 1, stepsize));
+        }
+        catch (const exception &e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        recorder->record(system->getState());
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (long step = 0; step < numSteps; ++step)
+    {
+        try
+        {
+            timeStepper->step(system.get(), stepsize);
+        }
+        catch (const exception &e)
+        {
+            // e.g. a stepper that can't step this kind of system.
+            cerr << e.what() << endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (timeStepper->failed())
+        {
+            cerr << "the time stepper failed at step " << step + 1 << "." << endl;
+            return 1;
+        }
+        if (recorder)
+            recorder->record(system->getState());
+    }
+    auto end = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(end - start).count();
+    double particleSteps = double(numSteps) * system->m_numParticles;
+    cout << "particles: " << system->m_numParticles << endl;
+    cout << "steps: " << numSteps << " in " << seconds << " s" << endl;
+    cout << "steps/sec: " << numSteps / seconds << endl;
+    cout << "ns per particle-step: " << seconds * 1e9 / particleSteps << endl;
+    if (DormandPrince *adaptive = dynamic_cast<DormandPrince *>(timeStepper.get()))
+    {
+        cout << "substeps accepted: " << adaptive->totalAccepted()
+             << ", rejected: " << adaptive->totalRejected()
+             << ", evalF calls: " << adaptive->totalEvaluations() << endl;
+    }
+
+    // "-" skips the text output.
+    if (argc > 7 && string(argv[7]) != "-")
+    {
+        ofstream out(argv[7]);
+        if (!out)
+        {
+            cerr << "can't open " << argv[7] << endl;
+            return 1;
+        }
+        writeState(out, system->getState());
+        cout << "final state written to " << argv[7] << endl;
+    }
+    // "-" skips the checkpoint.
+    if (argc > 8 && string(argv[8]) != "-")
+    {
+        try
+        {
+            system->saveCheckpoint(argv[8]);
+        }
+        catch (const exception &e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        cout << "checkpoint written to " << argv[8] << endl;
+    }
+    if (recorder)
+    {
+        recorder->finish();
+        cout << "trajectory: " << recorder->framesWritten() << " frames, "
+             << recorder->bytesWritten() << " bytes written to " << argv[9] << endl;
+    }
+    return 0;
+}
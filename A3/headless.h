@@ -0,0 +1,17 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+/**
+ * @brief runs a simulation without opening a window, as fast as possible.
+ * usage: a3 headless <c|p> <size|checkpoint> <stepper> <stepsize> <numSteps>
+ *        [outFile] [checkpointOut] [trajectoryOut [everyN]]
+ * c - cloth with size particles per side, p - pendulum with size particles,
+ * or restarted from a checkpoint. prints steps/sec and ns per particle-step.
+ * outFile gets the final state, one "px py pz vx vy vz" line per particle,
+ * checkpointOut a checkpoint of it ("-" skips either), and trajectoryOut a
+ * recording of every Nth step.
+ * returns the process exit code.
+ */
+int runHeadless(int argc, char *argv[]);
+
+#endif
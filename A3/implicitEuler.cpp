@@ -0,0 +1,176 @@
+#include "TimeStepper.hpp"
+#include "particleSpringSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <stdexcept>
+
+namespace
+{
+    double dot(const vector<float> &a, const vector<float> &b)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            sum += double(a[i]) * b[i];
+        return sum;
+    }
+}
+
+ImplicitEuler::ImplicitEuler(int maxIterations, float tolerance)
+    : m_maxIterations(maxIterations), m_tolerance(tolerance)
+{
+}
+
+void ImplicitEuler::filter(float *u)
+{
+    // constrained particles have no free degrees of freedom.
+    for (int p : m_constrained)
+        u[p] = u[m_n + p] = u[2 * m_n + p] = 0;
+}
+
+void ImplicitEuler::multiplyA(const float *u, float *out)
+{
+    const int n = m_n;
+    for (int i = 0; i < 3 * n; ++i)
+        out[i] = m_diagonal * u[i];
+    // -(h^2/m) df/dx u. per spring df0/dx1 = Ks = k (c (I - dd^T) + dd^T),
+    // df0/dx0 = -Ks, and the forces on p1 are the negatives.
+    for (const SpringJacobian &s : m_jacobians)
+    {
+        float ux = u[s.p1] - u[s.p0];
+        float uy = u[n + s.p1] - u[n + s.p0];
+        float uz = u[2 * n + s.p1] - u[2 * n + s.p0];
+        float along = s.dx * ux + s.dy * uy + s.dz * uz;
+        float w = m_stiffness * s.k;
+        float kx = w * (s.c * (ux - s.dx * along) + s.dx * along);
+        float ky = w * (s.c * (uy - s.dy * along) + s.dy * along);
+        float kz = w * (s.c * (uz - s.dz * along) + s.dz * along);
+        out[s.p0] -= kx;
+        out[n + s.p0] -= ky;
+        out[2 * n + s.p0] -= kz;
+        out[s.p1] += kx;
+        out[n + s.p1] += ky;
+        out[2 * n + s.p1] += kz;
+    }
+}
+
+void ImplicitEuler::takeStep(ParticleSystem *particleSystem, float stepSize)
+{
+    ParticleSpringSystem *system = dynamic_cast<ParticleSpringSystem *>(particleSystem);
+    if (!system)
+        throw invalid_argument("implicit euler only works on particle spring systems.");
+    const ParticleState &state = system->getState();
+    const int n = state.size();
+    if (m_f.size() != n)
+    {
+        m_f.resize(n);
+        m_next.resize(n);
+        for (vector<float> *v : {&m_dv, &m_b, &m_r, &m_c, &m_q, &m_s, &m_precond})
+            v->assign(3 * n, 0.f);
+    }
+    m_n = n;
+    const float h = stepSize;
+    const float mass = system->getParticleMass();
+    m_diagonal = 1 + h * system->getDrag() / mass;
+    m_stiffness = h * h / mass;
+
+    system->evalF(state, m_f);
+    system->getConstrainedParticles(m_constrained);
+    system->getActiveSpringRanges(m_ranges);
+
+    // spring jacobians at the current positions, and their diagonal blocks
+    // for the jacobi preconditioner.
+    const vector<Spring> &springs = system->getSprings();
+    const float *px = state.px(), *py = state.py(), *pz = state.pz();
+    fill(m_precond.begin(), m_precond.end(), m_diagonal);
+    m_jacobians.clear();
+    for (const SpringRange &sr : m_ranges)
+        for (int i = sr.start; i < sr.end; ++i)
+        {
+            const Spring &spring = springs[i];
+            float dx = px[spring.p1] - px[spring.p0];
+            float dy = py[spring.p1] - py[spring.p0];
+            float dz = pz[spring.p1] - pz[spring.p0];
+            float len = sqrt(dx * dx + dy * dy + dz * dz);
+            if (len == 0)
+                continue;
+            SpringJacobian s = {spring.p0, spring.p1, dx / len, dy / len, dz / len,
+                                spring.k, max(0.f, 1 - spring.r / len)};
+            m_jacobians.push_back(s);
+            float w = m_stiffness * s.k;
+            float diag[3] = {s.c + (1 - s.c) * s.dx * s.dx,
+                             s.c + (1 - s.c) * s.dy * s.dy,
+                             s.c + (1 - s.c) * s.dz * s.dz};
+            for (int c = 0; c < 3; ++c)
+            {
+                m_precond[c * n + s.p0] += w * diag[c];
+                m_precond[c * n + s.p1] += w * diag[c];
+            }
+        }
+
+    // b = h (a + (h/m) df/dx v). with A = diag - (h^2/m) df/dx, (h^2/m) df/dx v
+    // is diag v - A v.
+    const float *vel[3] = {state.vx(), state.vy(), state.vz()};
+    const float *acc[3] = {m_f.vx(), m_f.vy(), m_f.vz()};
+    const float *prescribed[3] = {m_f.px(), m_f.py(), m_f.pz()};
+    for (int c = 0; c < 3; ++c)
+        copy(vel[c], vel[c] + n, m_s.begin() + c * n);
+    multiplyA(m_s.data(), m_q.data());
+    for (int c = 0; c < 3; ++c)
+        for (int i = 0; i < n; ++i)
+            m_b[c * n + i] = h * acc[c][i] + (m_diagonal * vel[c][i] - m_q[c * n + i]);
+
+    // dv starts at the prescribed change for constrained particles, 0 elsewhere.
+    fill(m_dv.begin(), m_dv.end(), 0.f);
+    for (int p : m_constrained)
+        for (int c = 0; c < 3; ++c)
+            m_dv[c * n + p] = prescribed[c][p] - vel[c][p];
+
+    // modified preconditioned CG.
+    filter(m_b.data());
+    for (int i = 0; i < 3 * n; ++i)
+        m_s[i] = m_b[i] / m_precond[i];
+    double delta0 = dot(m_b, m_s);
+    multiplyA(m_dv.data(), m_q.data());
+    for (int i = 0; i < 3 * n; ++i)
+        m_r[i] = m_b[i] - m_q[i];
+    filter(m_r.data());
+    for (int i = 0; i < 3 * n; ++i)
+        m_c[i] = m_r[i] / m_precond[i];
+    filter(m_c.data());
+    double deltaNew = dot(m_r, m_c);
+    const double stop = double(m_tolerance) * m_tolerance * delta0;
+    m_lastIterations = 0;
+    while (deltaNew > stop && m_lastIterations < m_maxIterations)
+    {
+        multiplyA(m_c.data(), m_q.data());
+        filter(m_q.data());
+        double alpha = deltaNew / dot(m_c, m_q);
+        for (int i = 0; i < 3 * n; ++i)
+        {
+            m_dv[i] += alpha * m_c[i];
+            m_r[i] -= alpha * m_q[i];
+            m_s[i] = m_r[i] / m_precond[i];
+        }
+        double deltaOld = deltaNew;
+        deltaNew = dot(m_r, m_s);
+        float beta = deltaNew / deltaOld;
+        for (int i = 0; i < 3 * n; ++i)
+            m_c[i] = m_s[i] + beta * m_c[i];
+        filter(m_c.data());
+        ++m_lastIterations;
+    }
+
+    // v' = v + dv, x' = x + h v'.
+    float *nextPos[3] = {m_next.px(), m_next.py(), m_next.pz()};
+    float *nextVel[3] = {m_next.vx(), m_next.vy(), m_next.vz()};
+    const float *pos[3] = {px, py, pz};
+    for (int c = 0; c < 3; ++c)
+        for (int i = 0; i < n; ++i)
+        {
+            nextVel[c][i] = vel[c][i] + m_dv[c * n + i];
+            nextPos[c][i] = pos[c][i] + h * nextVel[c][i];
+        }
+    system->swapState(m_next);
+}
@@ -1,6 +1,9 @@
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <functional>
 #include <iostream>
 #include <vector>
 
@@ -14,6 +17,11 @@
 #include "simpleSystem.h"
 #include "pendulumSystem.h"
 #include "ClothSystem.h"
+#include "fixedStepLoop.h"
+#include "headless.h"
+#include "trajectory.h"
+#include "simulationThread.h"
+#include "sweep.h"
 
 using namespace std;
 
@@ -24,54 +32,124 @@ namespace
     ClothSystem *system;
     TimeStepper *timeStepper;
     float stepsize = 0.2f;
+    // simulated seconds per wall clock second in frame driven mode,
+    // what stepping 0.2 every 20 ms used to give.
+    const float timeScale = 10;
+    // steps system either on its own thread (simulation) or from the
+    // timer (frameLoop), 'x' switches between them.
+    bool threaded = true;
+    SimulationThread *simulation;
+    FixedStepLoop *frameLoop;
+    chrono::steady_clock::time_point lastFrame;
+    // "a3 replay <file>" plays a recorded trajectory instead of simulating.
+    TrajectoryReader *replay;
+    ParticleState replayState;
+    // 'k' saves a checkpoint here, 'l' loads it.
+    const char *checkpointFile = "a3.ckpt";
+    // the floor drawn below, and an optional mesh loaded from an obj file.
+    Obstacle floorObstacle;
+    Obstacle meshObstacle;
+
+    // what the window simulates, the batch runs don't print it.
+    void printSystem()
+    {
+        cout << "mass: " << system->getParticleMass() << endl;
+        cout << "drag: " << system->getDrag() << endl;
+        cout << "g: " << system->getGravity() << endl;
+        cout << "total num of springs: " << system->getSprings().size() << endl;
+    }
+
+    void setObstacles(ClothSystem *cloth)
+    {
+        cloth->obstacles = {&floorObstacle};
+        if (meshObstacle.numTriangles() > 0)
+            cloth->obstacles.push_back(&meshObstacle);
+    }
+
+    void startSimulation()
+    {
+        if (threaded)
+            simulation = new SimulationThread(system, timeStepper, stepsize);
+        else
+        {
+            frameLoop = new FixedStepLoop(system, timeStepper, stepsize, timeScale);
+            lastFrame = chrono::steady_clock::now();
+        }
+    }
+
+    void stopSimulation()
+    {
+        delete simulation;
+        simulation = nullptr;
+        delete frameLoop;
+        frameLoop = nullptr;
+    }
+
+    // runs command between two steps.
+    void changeSystem(function<void()> command)
+    {
+        if (simulation)
+            simulation->post(move(command));
+        else // frame driven or replaying, nothing is stepping right now.
+        {
+            command();
+            system->stateChanged();
+        }
+    }
+
     // initialize your particle systems
     void initSystem(int argc, char *argv[])
     {
         // seed the random number generator with the current time
         srand(time(NULL));
+        if (argc > 2 && string(argv[1]) == "replay")
+        {
+            replay = new TrajectoryReader(argv[2]);
+            // a cloth of the recorded size, just to draw the frames with.
+            int side = lround(sqrt(replay->numParticles()));
+            if (side * side != replay->numParticles())
+            {
+                cerr << argv[2] << " wasn't recorded from a cloth" << endl;
+                exit(1);
+            }
+            system = new ClothSystem(side);
+            replay->next(replayState);
+            return;
+        }
         system = new ClothSystem(3);
+        printSystem();
         // system = new ParticleSpringSystem(5);
         // system.setBasicSprings();
         if (argc > 1) // timeStepper type supplied.
+            timeStepper = createTimeStepper(argv[1]);
+        else // default - rk4.
+            timeStepper = createTimeStepper("r");
+        if (argc > 2) // stepsize supplied.
+            stepsize = atof(argv[2]);
+
+        // top face of the floor cube.
+        const float floorY = -5.0f + 0.005f;
+        floorObstacle.addTriangle(Vector3f(-25, floorY, -25), Vector3f(-25, floorY, 25), Vector3f(25, floorY, 25));
+        floorObstacle.addTriangle(Vector3f(-25, floorY, -25), Vector3f(25, floorY, 25), Vector3f(25, floorY, -25));
+        floorObstacle.build();
+        if (argc > 3) // obstacle mesh supplied.
         {
-            string solvertype = argv[1];
-            if (solvertype == "e")
+            // a mesh that can't be read is left out, the cloth runs without it.
+            try
             {
-                cout << "using Forward Euler" << endl;
-                timeStepper = new ForwardEuler();
+                Obstacle loaded;
+                loaded.loadObj(argv[3]);
+                loaded.build();
+                meshObstacle = move(loaded);
+                cout << "obstacle: " << meshObstacle.numTriangles() << " triangles" << endl;
             }
-            else if (solvertype == "t")
+            catch (const exception &e)
             {
-                cout << "using Trapezoidal" << endl;
-                timeStepper = new Trapzoidal();
+                cerr << e.what() << ", running without the obstacle." << endl;
             }
-            else if (solvertype == "r")
-            {
-                cout << "using RK4" << endl;
-                timeStepper = new RK4();
-            }
-            else
-                throw invalid_argument("can only choose e - forwardeuler, t - trapzoidal, or r - rk4.");
-        } // else + default - rk4.
-        else
-        {
-            cout << "using RK4" << endl;
-            timeStepper = new RK4();
-        }
-        if (argc > 2) // stepsize supplied.
-            stepsize = atof(argv[2]);
-    }
-
-    // Take a step forward for the particle shower
-    /// TODO: Optional. modify this function to display various particle systems
-    /// and switch between different timeSteppers
-    void stepSystem()
-    {
-        /// TODO The stepsize should change according to commandline arguments
-        if (timeStepper != 0)
-        {
-            timeStepper->takeStep(system, stepsize);
         }
+        setObstacles(system);
+        startSimulation();
     }
 
     // Draw the current particle positions
@@ -86,7 +164,13 @@ namespace
 
         // glutSolidSphere(0.1f, 10.0f, 10.0f);
 
-        system->draw();
+        if (replay)
+            system->draw(replayState);
+        else if (simulation)
+            system->draw(simulation->latest().state);
+        else
+            system->draw(frameLoop->interpolated());
+        meshObstacle.draw();
 
         glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, floorColor);
         glPushMatrix();
@@ -118,9 +202,16 @@ namespace
     // received.
     void keyboardFunc(unsigned char key, int x, int y)
     {
+        // a replay only draws, it has nothing to step or resize.
+        if (replay && strchr("abxklmczse", key))
+        {
+            cout << "not while replaying." << endl;
+            return;
+        }
         switch (key)
         {
         case 27: // Escape key
+            stopSimulation();
             exit(0);
             break;
         case ' ':
@@ -130,19 +221,23 @@ namespace
             camera.SetCenter(Vector3f::ZERO);
             break;
         }
+        // toggles read while stepping flip between two steps, see changeSystem.
         case 'f':
         {
-            system->toggleFlex = !system->toggleFlex;
+            changeSystem([]
+                         { system->toggleFlex = !system->toggleFlex; });
             break;
         }
         case 't':
         {
-            system->toggleStructure = !system->toggleStructure;
+            changeSystem([]
+                         { system->toggleStructure = !system->toggleStructure; });
             break;
         }
         case 'r':
         {
-            system->toggleShear = !system->toggleShear;
+            changeSystem([]
+                         { system->toggleShear = !system->toggleShear; });
             break;
         }
         case 'w':
@@ -154,20 +249,92 @@ namespace
         case 'a':
         {
             int numParticlesPerSide = system->m_numParticlesPerSide;
+            stopSimulation();
             delete system;
             system = new ClothSystem(numParticlesPerSide+1);
+            printSystem();
+            setObstacles(system);
+            startSimulation();
             break;
         }
         case 'b':
         {
             int numParticlesPerSide = system->m_numParticlesPerSide;
+            stopSimulation();
             delete system;
             system = new ClothSystem(numParticlesPerSide-1);
+            printSystem();
+            setObstacles(system);
+            startSimulation();
             break;
         }
         case 'm':
         {
-            system->toggleMoveAnchors = !system->toggleMoveAnchors;
+            changeSystem([]
+                         { system->toggleMoveAnchors = !system->toggleMoveAnchors; });
+            break;
+        }
+        case 'x':
+        {
+            stopSimulation();
+            threaded = !threaded;
+            startSimulation();
+            cout << (threaded ? "stepping on the simulation thread" : "stepping per frame") << endl;
+            break;
+        }
+        case 'k':
+        {
+            // saved between two steps, so the state is consistent.
+            changeSystem([]
+                         {
+                             try
+                             {
+                                 system->saveCheckpoint(checkpointFile);
+                                 cout << "checkpoint saved to " << checkpointFile << endl;
+                             }
+                             catch (const exception &e)
+                             {
+                                 cerr << e.what() << endl;
+                             } });
+            break;
+        }
+        case 'l':
+        {
+            stopSimulation();
+            try
+            {
+                system->loadCheckpoint(checkpointFile);
+                cout << "checkpoint loaded from " << checkpointFile << endl;
+            }
+            catch (const exception &e)
+            {
+                cerr << e.what() << endl;
+            }
+            startSimulation();
+            break;
+        }
+        case 'c':
+        {
+            changeSystem([]
+                         { system->toggleSelfCollision = !system->toggleSelfCollision; });
+            break;
+        }
+        case 'z':
+        {
+            changeSystem([]
+                         { system->toggleSleeping = !system->toggleSleeping; });
+            break;
+        }
+        case 's':
+        {
+            changeSystem([]
+                         { system->toggleStrainLimit = !system->toggleStrainLimit; });
+            break;
+        }
+        case 'e':
+        {
+            changeSystem([]
+                         { system->toggleTearing = !system->toggleTearing; });
             break;
         }
         default:
@@ -327,10 +494,22 @@ namespace
         glutSwapBuffers();
     }
 
+    // steps the frame driven loop by the time since the last frame and
+    // redraws, on its own thread the simulation doesn't need the timer.
     void timerFunc(int t)
     {
-        stepSystem();
-
+        if (replay && !replay->next(replayState))
+        {
+            // loop.
+            replay->rewind();
+            replay->next(replayState);
+        }
+        if (frameLoop)
+        {
+            auto now = chrono::steady_clock::now();
+            frameLoop->advance(chrono::duration<double>(now - lastFrame).count());
+            lastFrame = now;
+        }
         glutPostRedisplay();
 
         glutTimerFunc(t, &timerFunc, t);
@@ -342,6 +521,13 @@ namespace
 // Set up OpenGL, define the callbacks and start the main loop
 int main(int argc, char *argv[])
 {
+    // no window at all, just step as fast as possible.
+    if (argc > 1 && string(argv[1]) == "headless")
+        return runHeadless(argc, argv);
+    // many windowless runs over a parameter grid.
+    if (argc > 1 && string(argv[1]) == "sweep")
+        return runSweep(argc, argv);
+
     glutInit(&argc, argv);
 
     // We're going to animate it, so double buffer
@@ -0,0 +1,253 @@
+#include "obstacle.h"
+#include <GL/glut.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    // segment x0 + t (x1 - x0), t in [0, 1], against a triangle (moller-trumbore).
+    bool segmentHit(const Vector3f &x0, const Vector3f &x1, const Vector3f &a,
+                    const Vector3f &e1, const Vector3f &e2, float &t)
+    {
+        Vector3f dir = x1 - x0;
+        Vector3f p = Vector3f::cross(dir, e2);
+        float det = Vector3f::dot(e1, p);
+        if (std::fabs(det) < 1e-12f)
+            return false;
+        float inv = 1 / det;
+        Vector3f s = x0 - a;
+        float u = Vector3f::dot(s, p) * inv;
+        if (u < 0 || u > 1)
+            return false;
+        Vector3f q = Vector3f::cross(s, e1);
+        float w = Vector3f::dot(dir, q) * inv;
+        if (w < 0 || u + w > 1)
+            return false;
+        t = Vector3f::dot(e2, q) * inv;
+        return t >= 0 && t <= 1;
+    }
+
+    // closest point to p on the triangle a, a + e1, a + e2 (ericson 5.1.5).
+    Vector3f closestPoint(const Vector3f &p, const Vector3f &a, const Vector3f &e1, const Vector3f &e2)
+    {
+        Vector3f ap = p - a;
+        float d1 = Vector3f::dot(e1, ap), d2 = Vector3f::dot(e2, ap);
+        if (d1 <= 0 && d2 <= 0)
+            return a;
+        Vector3f bp = ap - e1;
+        float d3 = Vector3f::dot(e1, bp), d4 = Vector3f::dot(e2, bp);
+        if (d3 >= 0 && d4 <= d3)
+            return a + e1;
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0 && d1 >= 0 && d3 <= 0)
+            return a + d1 / (d1 - d3) * e1;
+        Vector3f cp = ap - e2;
+        float d5 = Vector3f::dot(e1, cp), d6 = Vector3f::dot(e2, cp);
+        if (d6 >= 0 && d5 <= d6)
+            return a + e2;
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0 && d2 >= 0 && d6 <= 0)
+            return a + d2 / (d2 - d6) * e2;
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+            return a + e1 + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (e2 - e1);
+        float denom = 1 / (va + vb + vc);
+        return a + vb * denom * e1 + vc * denom * e2;
+    }
+
+    // obj face corner "v", "v/vt", "v//vn" or "v/vt/vn", negative indices count from the back.
+    int vertexIndex(const std::string &corner, int numVertices)
+    {
+        int index = std::stoi(corner.substr(0, corner.find('/')));
+        index = index < 0 ? numVertices + index : index - 1;
+        if (index < 0 || index >= numVertices)
+            throw std::runtime_error("obj face refers to missing vertex " + corner);
+        return index;
+    }
+}
+
+void Obstacle::loadObj(const std::string &fileName)
+{
+    std::ifstream in(fileName);
+    if (!in)
+        throw std::runtime_error("can't open " + fileName);
+    loadObj(in);
+}
+
+void Obstacle::loadObj(std::istream &in)
+{
+    std::vector<Vector3f> vertices;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::stringstream ss(line);
+        std::string s;
+        ss >> s;
+        if (s == "v")
+        {
+            Vector3f v;
+            ss >> v[0] >> v[1] >> v[2];
+            vertices.push_back(v);
+        }
+        else if (s == "f")
+        {
+            std::vector<int> face;
+            std::string corner;
+            while (ss >> corner)
+                face.push_back(vertexIndex(corner, (int)vertices.size()));
+            for (size_t i = 2; i < face.size(); ++i)
+                addTriangle(vertices[face[0]], vertices[face[i - 1]], vertices[face[i]]);
+        }
+    }
+}
+
+void Obstacle::addTriangle(const Vector3f &a, const Vector3f &b, const Vector3f &c)
+{
+    Triangle t;
+    t.a = a;
+    t.e1 = b - a;
+    t.e2 = c - a;
+    Vector3f n = Vector3f::cross(t.e1, t.e2);
+    if (n.abs() == 0) // degenerate, nothing to hit.
+        return;
+    t.n = n.normalized();
+    m_triangles.push_back(t);
+}
+
+void Obstacle::build()
+{
+    std::vector<Aabb> boxes(m_triangles.size());
+    for (size_t i = 0; i < m_triangles.size(); ++i)
+    {
+        const Triangle &t = m_triangles[i];
+        Vector3f b = t.a + t.e1, c = t.a + t.e2;
+        float pa[3] = {t.a[0], t.a[1], t.a[2]}, pb[3] = {b[0], b[1], b[2]}, pc[3] = {c[0], c[1], c[2]};
+        boxes[i].grow(pa);
+        boxes[i].grow(pb);
+        boxes[i].grow(pc);
+    }
+    m_bvh.build(boxes);
+}
+
+int Obstacle::collideParticle(Vector3f x0, Vector3f &x1, Vector3f &v) const
+{
+    int corrections = 0;
+    // each correction can slide the particle into another triangle, a few passes settle it.
+    for (int pass = 0; pass < 4; ++pass)
+    {
+        Aabb box;
+        for (int a = 0; a < 3; ++a)
+        {
+            box.lo[a] = std::min(x0[a], x1[a]) - thickness;
+            box.hi[a] = std::max(x0[a], x1[a]) + thickness;
+        }
+        // first triangle crossed on the way.
+        float first = 2;
+        int hit = -1;
+        m_bvh.query(box, [&](int i)
+                    {
+                        const Triangle &t = m_triangles[i];
+                        float s;
+                        if (segmentHit(x0, x1, t.a, t.e1, t.e2, s) && s < first)
+                        {
+                            first = s;
+                            hit = i;
+                        } });
+        Vector3f normal;
+        if (hit >= 0)
+        {
+            // back onto the side it came from, keeping the motion along the plane.
+            const Triangle &t = m_triangles[hit];
+            normal = Vector3f::dot(x0 - t.a, t.n) >= 0 ? t.n : -t.n;
+            x1 += (thickness - Vector3f::dot(x1 - t.a, normal)) * normal;
+        }
+        else
+        {
+            // no crossing, push out of the closest triangle within thickness.
+            float closest = thickness;
+            Vector3f q;
+            int near = -1;
+            m_bvh.query(box, [&](int i)
+                        {
+                            const Triangle &t = m_triangles[i];
+                            if (std::fabs(Vector3f::dot(x1 - t.a, t.n)) >= closest)
+                                return;
+                            Vector3f c = closestPoint(x1, t.a, t.e1, t.e2);
+                            float d = (x1 - c).abs();
+                            if (d < closest)
+                            {
+                                closest = d;
+                                q = c;
+                                near = i;
+                            } });
+            if (near < 0)
+                break;
+            const Triangle &t = m_triangles[near];
+            if (closest > 0)
+                normal = (x1 - q) / closest;
+            else
+                normal = Vector3f::dot(x0 - t.a, t.n) >= 0 ? t.n : -t.n;
+            x1 = q + thickness * normal;
+        }
+        ++corrections;
+
+        // inelastic in the normal direction, coulomb friction along the surface.
+        float vn = Vector3f::dot(v, normal);
+        if (vn < 0)
+        {
+            v -= vn * normal;
+            float vt = v.abs();
+            if (vt > 0)
+                v *= std::max(0.f, 1 + friction * vn / vt);
+        }
+    }
+    return corrections;
+}
+
+int Obstacle::collide(ParticleState &state, const ParticleState &previous,
+                      const std::vector<char> &isPinned, ThreadPool *pool) const
+{
+    if (m_triangles.empty())
+        return 0;
+    std::atomic<int> corrections(0);
+    auto body = [&](int begin, int end)
+    {
+        int local = 0;
+        for (int i = begin; i < end; ++i)
+        {
+            if (isPinned[i])
+                continue;
+            Vector3f x1 = state.getPosition(i), v = state.getVelocity(i);
+            int c = collideParticle(previous.getPosition(i), x1, v);
+            if (c > 0)
+            {
+                state.setPosition(i, x1);
+                state.setVelocity(i, v);
+                local += c;
+            }
+        }
+        corrections += local;
+    };
+    if (pool)
+        pool->parallelFor(0, state.size(), body, 256);
+    else
+        body(0, state.size());
+    return corrections;
+}
+
+void Obstacle::draw() const
+{
+    glBegin(GL_TRIANGLES);
+    for (const Triangle &t : m_triangles)
+    {
+        glNormal3fv(t.n);
+        glVertex3fv(t.a);
+        glVertex3fv(t.a + t.e1);
+        glVertex3fv(t.a + t.e2);
+    }
+    glEnd();
+}
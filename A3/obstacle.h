@@ -0,0 +1,62 @@
+#ifndef OBSTACLE_H
+#define OBSTACLE_H
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <vecmath.h>
+
+#include "bvh.h"
+#include "particleState.h"
+#include "threadPool.h"
+
+/**
+ * @brief static triangle mesh the particles collide with.
+ * a particle's path over a step is the segment from its previous position to
+ * its current one, it is swept against the triangles (found through a sah
+ * bvh) and stopped thickness in front of the first one it crosses. particles
+ * that end up closer than thickness to a triangle are pushed out as well, so
+ * cloth can rest on the mesh. the mesh is read only while colliding, the
+ * particles are split across threads.
+ */
+class Obstacle
+{
+public:
+	float thickness = 0.05f;
+	// coulomb friction coefficient of the tangential velocity.
+	float friction = 0.3f;
+
+	/**
+	 * @brief appends the triangles of an obj file (v and f lines, as in A0,
+	 * polygons are split into fans). throws runtime_error if it can't be read.
+	 */
+	void loadObj(const std::string &fileName);
+	void loadObj(std::istream &in);
+	void addTriangle(const Vector3f &a, const Vector3f &b, const Vector3f &c);
+	// (re)builds the bvh, call it after adding triangles.
+	void build();
+	int numTriangles() const { return (int)m_triangles.size(); }
+
+	/**
+	 * @brief moves the particles of state whose path from previous went
+	 * through or ends too close to the mesh, and removes their velocity into it.
+	 * particles with isPinned[i] != 0 are left alone. returns the number of
+	 * corrections.
+	 */
+	int collide(ParticleState &state, const ParticleState &previous,
+				const std::vector<char> &isPinned, ThreadPool *pool) const;
+
+	void draw() const;
+
+private:
+	struct Triangle
+	{
+		Vector3f a, e1, e2;
+		Vector3f n; // unit normal
+	};
+	int collideParticle(Vector3f x0, Vector3f &x1, Vector3f &v) const;
+	std::vector<Triangle> m_triangles;
+	Bvh m_bvh;
+};
+
+#endif
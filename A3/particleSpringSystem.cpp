@@ -1,36 +1,43 @@
 
 #include "particleSpringSystem.h"
+#include <algorithm>
+#include <atomic>
 #include <cmath>
-#include <iostream>
+#include <cstdint>
+#include <stdexcept>
 
 ParticleSpringSystem::ParticleSpringSystem(int numParticles) : ParticleSystem(numParticles)
  {
-	cout<<"mass: " << particleMass << endl;
-	cout<<"drag: " << drag << endl;
-	cout<<"g: " << g << endl;
+	bumpSpringsGeneration();
  }
 
-Vector3f ParticleSpringSystem::getPosition(int particleIdx, const vector<Vector3f> &state)
+void ParticleSpringSystem::bumpSpringsGeneration()
 {
-	return state.at(particleIdx * 2);
+	static std::atomic<unsigned long long> generation{0};
+	m_springsGeneration = ++generation;
 }
 
-Vector3f ParticleSpringSystem::getVelocity(int particleIdx, const vector<Vector3f> &state)
+Vector3f ParticleSpringSystem::getPosition(int particleIdx, const ParticleState &state)
 {
-	return state.at(particleIdx * 2 + 1);
+	return state.getPosition(particleIdx);
+}
+
+Vector3f ParticleSpringSystem::getVelocity(int particleIdx, const ParticleState &state)
+{
+	return state.getVelocity(particleIdx);
 }
 
 Vector3f ParticleSpringSystem::getPosition(int particleIdx)
 {
-	return m_vVecState.at(particleIdx * 2);
+	return m_vVecState.getPosition(particleIdx);
 }
 
 Vector3f ParticleSpringSystem::getVelocity(int particleIdx)
 {
-	return m_vVecState.at(particleIdx * 2 + 1);
+	return m_vVecState.getVelocity(particleIdx);
 }
 
-Vector3f ParticleSpringSystem::springForce(const Spring &s, const vector<Vector3f> &state)
+Vector3f ParticleSpringSystem::springForce(const Spring &s, const ParticleState &state)
 {
 	// −k(||d|| − r)*d/||d|| (i.e. vector direction) , where d = xi − xj.
 	Vector3f p0 = getPosition(s.p0, state);
@@ -47,6 +54,245 @@ Vector3f ParticleSpringSystem::springForce(const Spring &s)
 	return s.k * (d.abs() - s.r) * d.normalized();
 }
 
+void ParticleSpringSystem::getActiveSpringRanges(vector<SpringRange> &ranges) const
+{
+	ranges.clear();
+	ranges.push_back(SpringRange{0, (int)springs.size()});
+}
+
+void ParticleSpringSystem::getConstrainedParticles(vector<int> &particles) const
+{
+	particles.clear();
+}
+
+void ParticleSpringSystem::setSpringStiffness(float k)
+{
+	for (Spring &s : springs)
+		s.k = k;
+	notifySpringsChanged();
+}
+
+void ParticleSpringSystem::getSortableSpringRanges(vector<SpringRange> &ranges) const
+{
+	ranges.clear();
+	ranges.push_back(SpringRange{0, (int)springs.size()});
+}
+
+void ParticleSpringSystem::reorderParticles(const vector<int> &newOrder)
+{
+	if ((int)newOrder.size() != m_numParticles)
+		throw invalid_argument("reorderParticles: the order doesn't have one entry per particle.");
+	vector<int> newIndex(m_numParticles, -1);
+	for (int i = 0; i < m_numParticles; ++i)
+	{
+		int old = newOrder[i];
+		if (old < 0 || old >= m_numParticles || newIndex[old] != -1)
+			throw invalid_argument("reorderParticles: the order isn't a permutation.");
+		newIndex[old] = i;
+	}
+
+	ParticleState reordered(m_numParticles);
+	const int stride = m_vVecState.stride();
+	for (int c = 0; c < 6; ++c)
+	{
+		const float *from = m_vVecState.data() + c * stride;
+		float *to = reordered.data() + c * stride;
+		for (int i = 0; i < m_numParticles; ++i)
+			to[i] = from[newOrder[i]];
+	}
+	swapState(reordered);
+
+	// the force on p0 is the negative of the one on p1, so the ends can swap.
+	for (Spring &s : springs)
+	{
+		int a = newIndex[s.p0], b = newIndex[s.p1];
+		s.p0 = min(a, b);
+		s.p1 = max(a, b);
+	}
+	vector<SpringRange> ranges;
+	getSortableSpringRanges(ranges);
+	for (const SpringRange &sr : ranges)
+		stable_sort(springs.begin() + sr.start, springs.begin() + sr.end,
+					[](const Spring &a, const Spring &b)
+					{ return a.p0 < b.p0; });
+
+	// on top of any earlier reordering.
+	vector<int> originalIndex(m_numParticles);
+	for (int i = 0; i < m_numParticles; ++i)
+		originalIndex[i] = this->originalIndex(newOrder[i]);
+	m_originalIndex.swap(originalIndex);
+	m_particleIndex.resize(m_numParticles);
+	for (int i = 0; i < m_numParticles; ++i)
+		m_particleIndex[m_originalIndex[i]] = i;
+	notifySpringsChanged();
+}
+
+namespace
+{
+	// the bits of x spread out to every third bit.
+	uint64_t spreadBits(uint32_t x)
+	{
+		uint64_t v = x & 0x1fffff;
+		v = (v | v << 32) & 0x1f00000000ffffull;
+		v = (v | v << 16) & 0x1f0000ff0000ffull;
+		v = (v | v << 8) & 0x100f00f00f00f00full;
+		v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+		v = (v | v << 2) & 0x1249249249249249ull;
+		return v;
+	}
+}
+
+void ParticleSpringSystem::reorderParticlesMorton()
+{
+	if (m_numParticles == 0)
+		return;
+	// 21 bits per axis over the bounding box.
+	const float *p[3] = {m_vVecState.px(), m_vVecState.py(), m_vVecState.pz()};
+	float lo[3], scale[3];
+	for (int c = 0; c < 3; ++c)
+	{
+		lo[c] = *min_element(p[c], p[c] + m_numParticles);
+		float extent = *max_element(p[c], p[c] + m_numParticles) - lo[c];
+		scale[c] = extent > 0 ? 0x1fffff / extent : 0.f;
+	}
+	vector<pair<uint64_t, int>> keys(m_numParticles);
+	for (int i = 0; i < m_numParticles; ++i)
+	{
+		uint64_t key = 0;
+		for (int c = 0; c < 3; ++c)
+		{
+			// nan (or a non finite box) goes to 0, converting it would be undefined.
+			float q = (p[c][i] - lo[c]) * scale[c];
+			q = q > 0 ? min(q, float(0x1fffff)) : 0.f;
+			key |= spreadBits(uint32_t(q)) << c;
+		}
+		keys[i] = {key, i};
+	}
+	sort(keys.begin(), keys.end());
+	vector<int> order(m_numParticles);
+	for (int i = 0; i < m_numParticles; ++i)
+		order[i] = keys[i].second;
+	reorderParticles(order);
+}
+
+namespace
+{
+	const uint32_t kSpringsTag = checkpoint::tag("SPRG");
+	const uint32_t kParametersTag = checkpoint::tag("PARM");
+	const uint32_t kOrderTag = checkpoint::tag("ORDR");
+	struct SpringParameters
+	{
+		float drag, g, particleMass;
+	};
+}
+
+void ParticleSpringSystem::writeCheckpoint(checkpoint::Writer &out) const
+{
+	ParticleSystem::writeCheckpoint(out);
+	out.add(kSpringsTag, springs);
+	out.addValue(kParametersTag, SpringParameters{drag, g, particleMass});
+	if (!m_originalIndex.empty())
+		out.add(kOrderTag, m_originalIndex);
+}
+
+void ParticleSpringSystem::readCheckpoint(const checkpoint::Reader &in)
+{
+	LoadedSprings loaded;
+	readSprings(in, loaded);
+	useSprings(loaded);
+}
+
+void ParticleSpringSystem::readSprings(const checkpoint::Reader &in, LoadedSprings &loaded) const
+{
+	readState(in, loaded.state);
+	const int numParticles = loaded.state.size();
+	in.read(kSpringsTag, loaded.springs);
+	for (const Spring &s : loaded.springs)
+		if (s.p0 < 0 || s.p0 >= numParticles || s.p1 < 0 || s.p1 >= numParticles)
+			throw std::runtime_error("checkpoint spring refers to a missing particle");
+	SpringParameters parameters;
+	in.readValue(kParametersTag, parameters);
+	loaded.drag = parameters.drag;
+	loaded.g = parameters.g;
+	loaded.particleMass = parameters.particleMass;
+	// only there if the particles were reordered.
+	size_t bytes;
+	loaded.originalIndex.clear();
+	loaded.particleIndex.clear();
+	if (in.find(kOrderTag, bytes))
+	{
+		in.read(kOrderTag, loaded.originalIndex);
+		if ((int)loaded.originalIndex.size() != numParticles)
+			throw std::runtime_error("checkpoint particle order doesn't match the particle count");
+		loaded.particleIndex.assign(numParticles, -1);
+		for (int i = 0; i < numParticles; ++i)
+		{
+			int original = loaded.originalIndex[i];
+			if (original < 0 || original >= numParticles || loaded.particleIndex[original] != -1)
+				throw std::runtime_error("checkpoint particle order isn't a permutation");
+			loaded.particleIndex[original] = i;
+		}
+	}
+}
+
+void ParticleSpringSystem::useSprings(LoadedSprings &loaded)
+{
+	m_numParticles = loaded.state.size();
+	swapState(loaded.state);
+	springs.swap(loaded.springs);
+	drag = loaded.drag;
+	g = loaded.g;
+	particleMass = loaded.particleMass;
+	m_originalIndex.swap(loaded.originalIndex);
+	m_particleIndex.swap(loaded.particleIndex);
+	// the subclass calls springsChanged once its own spring bookkeeping is loaded.
+	bumpSpringsGeneration();
+}
+
+void ParticleSpringSystem::addSpringForces(ParticleState &f, const SpringRange &sr, const ParticleState &state)
+{
+	springForceKernel(springs.data() + sr.start, sr.end - sr.start,
+					  state.px(), state.py(), state.pz(), f.vx(), f.vy(), f.vz());
+}
+
+vector<SpringRange> ParticleSpringSystem::colorSprings(const SpringRange &sr)
+{
+	// bit c of usedColors[p] is set once particle p has a spring of color c.
+	vector<uint64_t> usedColors(m_numParticles, 0);
+	vector<int> color(sr.end - sr.start);
+	vector<int> colorSize;
+	for (int i = sr.start; i < sr.end; ++i)
+	{
+		const Spring &s = springs[i];
+		uint64_t freeColors = ~(usedColors[s.p0] | usedColors[s.p1]);
+		if (freeColors == 0)
+			throw runtime_error("colorSprings: more than 64 springs on one particle.");
+		int c = __builtin_ctzll(freeColors);
+		usedColors[s.p0] |= uint64_t(1) << c;
+		usedColors[s.p1] |= uint64_t(1) << c;
+		color[i - sr.start] = c;
+		if (c >= (int)colorSize.size())
+			colorSize.resize(c + 1, 0);
+		++colorSize[c];
+	}
+	// stable counting sort of the springs by color.
+	vector<SpringRange> colors(colorSize.size());
+	int start = sr.start;
+	for (unsigned c = 0; c < colors.size(); ++c)
+	{
+		colors[c] = {start, start + colorSize[c]};
+		start += colorSize[c];
+	}
+	vector<Spring> sorted(sr.end - sr.start);
+	vector<int> next(colors.size());
+	for (unsigned c = 0; c < colors.size(); ++c)
+		next[c] = colors[c].start - sr.start;
+	for (int i = sr.start; i < sr.end; ++i)
+		sorted[next[color[i - sr.start]]++] = springs[i];
+	copy(sorted.begin(), sorted.end(), springs.begin() + sr.start);
+	return colors;
+}
+
 // render the system (ie draw the particles)
 void ParticleSpringSystem::draw()
 {
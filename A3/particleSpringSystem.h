@@ -7,6 +7,7 @@
 
 #include "particleSystem.h"
 #include "Spring.h"
+#include "springKernel.h"
 
 class ParticleSpringSystem: public ParticleSystem
 {
@@ -15,18 +16,101 @@ public:
 	ParticleSpringSystem();
 	virtual void setupBasicSprings() = 0;
 	virtual void draw();
+	// kernel used for the spring forces in evalF, picked by cpu features.
+	SpringForceKernel springForceKernel = bestSpringForceKernel();
+
+	// read access for integrators that work on the springs themselves.
+	const vector<Spring> &getSprings() const { return springs; }
+	float getParticleMass() const { return particleMass; }
+	float getDrag() const { return drag; }
+	float getGravity() const { return g; }
+	// for tuning and parameter sweeps.
+	void setParticleMass(float mass) { particleMass = mass; }
+	void setDrag(float d) { drag = d; }
+	void setGravity(float gravity) { g = gravity; }
+	// sets k of every spring.
+	void setSpringStiffness(float k);
+	// ranges of springs currently exerting forces, all of them by default.
+	virtual void getActiveSpringRanges(vector<SpringRange> &ranges) const;
+	// particles whose motion evalF prescribes (pinned or driven) instead of integrating it.
+	// their prescribed velocity is the position slot of evalF. none by default.
+	virtual void getConstrainedParticles(vector<int> &particles) const;
+	/**
+	 * @brief renumbers the particles for memory locality: particle i becomes the one
+	 * that was newOrder[i]. moves the state, remaps the springs (p0 becomes the
+	 * lower end) and sorts the springs of every getSortableSpringRanges range by p0.
+	 * call it before stepping, steppers may keep per particle data across steps.
+	 * throws invalid_argument if newOrder isn't a permutation of the particles.
+	 */
+	void reorderParticles(const vector<int> &newOrder);
+	// reorders the particles along a morton (z order) curve through their current positions.
+	void reorderParticlesMorton();
+	// index of the particle that had index originalIndex before any reordering.
+	int particleIndex(int originalIndex) const
+	{
+		return m_particleIndex.empty() ? originalIndex : m_particleIndex[originalIndex];
+	}
+	// changes whenever the springs are replaced, remapped, reordered or removed, so
+	// caches built from them (e.g. SpringJacobianAssembler's pattern) know to rebuild.
+	// the values come from one global counter, no two systems ever share one.
+	unsigned long long springsGeneration() const { return m_springsGeneration; }
+	// the inverse of particleIndex.
+	int originalIndex(int particleIdx) const
+	{
+		return m_originalIndex.empty() ? particleIdx : m_originalIndex[particleIdx];
+	}
 
 protected:
-	Vector3f getPosition(int particleIdx, const vector<Vector3f> &state);
-	Vector3f getVelocity(int particleIdx, const vector<Vector3f> &state);	
+	Vector3f getPosition(int particleIdx, const ParticleState &state);
+	Vector3f getVelocity(int particleIdx, const ParticleState &state);
 	Vector3f getPosition(int particleIdx);
 	Vector3f getVelocity(int particleIdx);
-	Vector3f springForce(const Spring &s, const vector<Vector3f> &state);
+	Vector3f springForce(const Spring &s, const ParticleState &state);
 	Vector3f springForce(const Spring &s);
+	// adds the forces of the springs in sr to the velocity slots of f.
+	void addSpringForces(ParticleState &f, const SpringRange &sr, const ParticleState &state);
+	/**
+	 * @brief greedily colors the springs in sr so that no two springs of a color
+	 * share a particle, and reorders them so each color is contiguous.
+	 * @return the range of every color, in order.
+	 */
+	vector<SpringRange> colorSprings(const SpringRange &sr);
+	// called after the springs were changed in place, e.g. by setSpringStiffness.
+	virtual void springsChanged() {}
+	// gives springsGeneration a new value.
+	void bumpSpringsGeneration();
+	// bumps springsGeneration and the state generation and calls springsChanged.
+	void notifySpringsChanged()
+	{
+		bumpSpringsGeneration();
+		stateChanged();
+		springsChanged();
+	}
+	// ranges of springs whose order within doesn't matter. all springs by default.
+	virtual void getSortableSpringRanges(vector<SpringRange> &ranges) const;
+	// adds the springs and the drag, g and mass parameters.
+	void writeCheckpoint(checkpoint::Writer &out) const override;
+	void readCheckpoint(const checkpoint::Reader &in) override;
+	// the sections readCheckpoint loads, read and checked by readSprings.
+	struct LoadedSprings
+	{
+		ParticleState state;
+		vector<Spring> springs;
+		float drag, g, particleMass;
+		vector<int> originalIndex, particleIndex;
+	};
+	// throws runtime_error if the sections don't fit, the system stays as it was.
+	void readSprings(const checkpoint::Reader &in, LoadedSprings &loaded) const;
+	// swaps loaded in, can't fail.
+	void useSprings(LoadedSprings &loaded);
 	vector<Spring> springs;
 	float drag = 0.5f;
 	float g = 1.f;
 	float particleMass = .05f; // kg
+	// original index of every particle and the other way around, empty until reordered.
+	vector<int> m_originalIndex;
+	vector<int> m_particleIndex;
+	unsigned long long m_springsGeneration;
 };
 
 #endif
@@ -0,0 +1,20 @@
+#include "particleState.h"
+#include <algorithm>
+
+ParticleState::ParticleState(int numParticles) : m_numParticles(0), m_stride(0)
+{
+    resize(numParticles);
+}
+
+void ParticleState::resize(int numParticles)
+{
+    m_numParticles = numParticles;
+    // round up to a multiple of 8 floats so every array stays 32 byte aligned.
+    m_stride = (numParticles + 7) & ~7;
+    m_data.assign(6 * m_stride, 0.f);
+}
+
+void ParticleState::setZero()
+{
+    std::fill(m_data.begin(), m_data.end(), 0.f);
+}
@@ -0,0 +1,102 @@
+#ifndef PARTICLESTATE_H
+#define PARTICLESTATE_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <vecmath.h>
+
+/**
+ * @brief std allocator handing out Alignment-byte aligned blocks,
+ * so the component arrays of a ParticleState start on an AVX boundary.
+ */
+template <typename T, std::size_t Alignment = 32>
+struct AlignedAllocator
+{
+	typedef T value_type;
+	template <typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() = default;
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+	T *allocate(std::size_t n)
+	{
+		return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+	void deallocate(T *p, std::size_t)
+	{
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+};
+
+/**
+ * @brief state of a particle system, kept as structure of arrays:
+ * px, py, pz hold the positions and vx, vy, vz the velocities.
+ * all six arrays live back to back in one aligned block and are padded
+ * to a multiple of 8 floats, so a time stepper can also walk the whole
+ * state as one flat float array (see data() / numFloats()).
+ * the derivative of a state has the same shape, with the velocities in
+ * the position slots and the accelerations in the velocity slots.
+ */
+class ParticleState
+{
+public:
+	ParticleState(int numParticles = 0);
+
+	// resizes to numParticles particles, all at the origin and at rest.
+	void resize(int numParticles);
+	void setZero();
+
+	int size() const { return m_numParticles; }
+	// distance (in floats) between two consecutive component arrays.
+	int stride() const { return m_stride; }
+
+	// flat view over all components, padding included.
+	int numFloats() const { return 6 * m_stride; }
+	float *data() { return m_data.data(); }
+	const float *data() const { return m_data.data(); }
+
+	float *px() { return m_data.data(); }
+	float *py() { return m_data.data() + m_stride; }
+	float *pz() { return m_data.data() + 2 * m_stride; }
+	float *vx() { return m_data.data() + 3 * m_stride; }
+	float *vy() { return m_data.data() + 4 * m_stride; }
+	float *vz() { return m_data.data() + 5 * m_stride; }
+	const float *px() const { return m_data.data(); }
+	const float *py() const { return m_data.data() + m_stride; }
+	const float *pz() const { return m_data.data() + 2 * m_stride; }
+	const float *vx() const { return m_data.data() + 3 * m_stride; }
+	const float *vy() const { return m_data.data() + 4 * m_stride; }
+	const float *vz() const { return m_data.data() + 5 * m_stride; }
+
+	Vector3f getPosition(int i) const { return Vector3f(px()[i], py()[i], pz()[i]); }
+	Vector3f getVelocity(int i) const { return Vector3f(vx()[i], vy()[i], vz()[i]); }
+	void setPosition(int i, const Vector3f &p)
+	{
+		px()[i] = p.x();
+		py()[i] = p.y();
+		pz()[i] = p.z();
+	}
+	void setVelocity(int i, const Vector3f &v)
+	{
+		vx()[i] = v.x();
+		vy()[i] = v.y();
+		vz()[i] = v.z();
+	}
+
+private:
+	int m_numParticles;
+	int m_stride;
+	std::vector<float, AlignedAllocator<float>> m_data;
+};
+
+#endif
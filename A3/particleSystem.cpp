@@ -1,3 +1,70 @@
 #include "particleSystem.h"
+#include <atomic>
+#include <typeinfo>
 ParticleSystem::ParticleSystem(int nParticles):m_numParticles(nParticles){
+	stateChanged();
+}
+
+namespace
+{
+	std::atomic<unsigned long long> g_stateGeneration{0};
+
+	// class of the system that wrote the checkpoint.
+	const uint32_t kKindTag = checkpoint::tag("KIND");
+	const uint32_t kParticleCountTag = checkpoint::tag("NPAR");
+	const uint32_t kStateTag = checkpoint::tag("STAT");
+}
+
+void ParticleSystem::saveCheckpoint(const std::string &fileName) const
+{
+	checkpoint::Writer out;
+	writeCheckpoint(out);
+	out.write(fileName);
+}
+
+void ParticleSystem::loadCheckpoint(const std::string &fileName)
+{
+	checkpoint::Reader in(fileName);
+	readCheckpoint(in);
+	stateChanged();
+}
+
+void ParticleSystem::stateChanged()
+{
+	m_stateGeneration = ++g_stateGeneration;
+}
+
+void ParticleSystem::writeCheckpoint(checkpoint::Writer &out) const
+{
+	const char *kind = typeid(*this).name();
+	out.add(kKindTag, kind, std::strlen(kind));
+	out.addValue(kParticleCountTag, m_numParticles);
+	// the whole state block, padding included.
+	out.add(kStateTag, m_vVecState.data(), m_vVecState.numFloats() * sizeof(float));
+}
+
+void ParticleSystem::readCheckpoint(const checkpoint::Reader &in)
+{
+	ParticleState state;
+	readState(in, state);
+	m_numParticles = state.size();
+	swapState(state);
+}
+
+void ParticleSystem::readState(const checkpoint::Reader &in, ParticleState &state) const
+{
+	size_t kindLength;
+	const char *kind = static_cast<const char *>(in.require(kKindTag, kindLength));
+	if (std::string(kind, kindLength) != typeid(*this).name())
+		throw std::runtime_error("checkpoint was saved by another kind of system");
+	int numParticles;
+	in.readValue(kParticleCountTag, numParticles);
+	if (numParticles < 0)
+		throw std::runtime_error("checkpoint has a negative particle count");
+	state = ParticleState(numParticles);
+	size_t bytes;
+	const void *data = in.require(kStateTag, bytes);
+	if (bytes != state.numFloats() * sizeof(float))
+		throw std::runtime_error("checkpoint state doesn't match its particle count");
+	std::memcpy(state.data(), data, bytes);
 }
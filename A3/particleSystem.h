@@ -1,9 +1,14 @@
 #ifndef PARTICLESYSTEM_H
 #define PARTICLESYSTEM_H
 
+#include <string>
+#include <utility>
 #include <vector>
 #include <vecmath.h>
 
+#include "checkpoint.h"
+#include "particleState.h"
+
 using namespace std;
 
 class ParticleSystem
@@ -11,26 +16,64 @@ class ParticleSystem
 public:
 
 	ParticleSystem(int numParticles=0);
+	virtual ~ParticleSystem() {}
 
 	int m_numParticles;
 	
-	// for a given state, evaluate derivative f(X,t)
-	virtual vector<Vector3f> evalF(vector<Vector3f> state) = 0;
+	// for a given state, evaluate derivative f(X,t) into f.
+	// f is owned by the caller and must already hold state.size() particles,
+	// every particle slot of it is overwritten.
+	virtual void evalF(const ParticleState &state, ParticleState &f) = 0;
 	
 	// getter method for the system's state
-	vector<Vector3f> getState(){ return m_vVecState; };
+	const ParticleState &getState() const { return m_vVecState; };
 	
 	// setter method for the system's state
-	void setState(const vector<Vector3f>  & newState) { m_vVecState = newState; };
+	void setState(const ParticleState & newState) { m_vVecState = newState; stateChanged(); };
+
+	// for steppers that update the state in place.
+	ParticleState &getMutableState() { return m_vVecState; };
+
+	// replaces the state with newState without copying,
+	// newState gets the old state back (handy as scratch for the next step).
+	void swapState(ParticleState &newState) { std::swap(m_vVecState, newState); };
 	
+	// called around every full time step (see TimeStepper::step),
+	// for corrections that aren't forces, like collisions.
+	virtual void beforeStep(float stepSize) {}
+	virtual void afterStep(float stepSize) {}
+
+	// changes whenever the state or anything evalF depends on was changed
+	// outside a time stepper's takeStep: corrections in before/afterStep,
+	// parameters, springs, checkpoint loads. the values come from one global
+	// counter, so no two systems ever share one.
+	unsigned long long stateGeneration() const { return m_stateGeneration; }
+	void stateChanged();
+
 	virtual void draw() = 0;
+
+	// writes everything needed to restart the system to a binary checkpoint
+	// (see checkpoint.h). throws runtime_error if it can't.
+	void saveCheckpoint(const std::string &fileName) const;
+	// restores a checkpoint saved by the same kind of system, particle count included.
+	// throws runtime_error if the file doesn't fit.
+	void loadCheckpoint(const std::string &fileName);
 	
 protected:
-	// vector state of particles.
-	// 0mod2 contains positions of particles.
-	// 1mod2 contains velocities of particles.
-	vector<Vector3f> m_vVecState;
-	
+	// the sections of the system, overrides add theirs to the base class ones.
+	virtual void writeCheckpoint(checkpoint::Writer &out) const;
+	// loads a checkpoint, all or nothing: everything is read and checked before
+	// any of it replaces the system's own.
+	virtual void readCheckpoint(const checkpoint::Reader &in);
+	// reads and checks the state sections into state, throws runtime_error
+	// if they don't fit this system.
+	void readState(const checkpoint::Reader &in, ParticleState &state) const;
+
+	// state of particles, positions and velocities in separate x/y/z arrays.
+	ParticleState m_vVecState;
+
+private:
+	unsigned long long m_stateGeneration;
 };
 
 #endif
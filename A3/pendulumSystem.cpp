@@ -6,14 +6,11 @@ PendulumSystem::PendulumSystem(int numParticles): ParticleSpringSystem(numPartic
     // fill in code for initializing the state based on the number of particles
     // let's assume the first particle described is always the fixed one.
 
-    m_vVecState.push_back(Vector3f(0, 1, 0)); // fixed particle location (just 1 up)
-	m_vVecState.push_back(Vector3f(0, 0, 0)); // particle starts at rest (and is fixes so won't change)
+    m_vVecState.resize(m_numParticles); // particles start at rest.
+    m_vVecState.setPosition(0, Vector3f(0, 1, 0)); // fixed particle location (just 1 up)
 
 	for (int i = 1; i < m_numParticles; i++) // we're starting w. a fixed particle always.
-	{
-		m_vVecState.push_back(Vector3f(float(i), 1, float(i) + 1)); // starting at spring rest distance.
-		m_vVecState.push_back(Vector3f(0, 0, 0));					// particle starts at rest.
-	}
+		m_vVecState.setPosition(i, Vector3f(float(i), 1, float(i) + 1)); // starting at spring rest distance.
     setupBasicSprings();
 }
 
@@ -25,34 +22,32 @@ void PendulumSystem::setupBasicSprings()
 		if (i > 1)
 			springs.push_back({i - 2, i, .5f, .1f});
 	}
+	notifySpringsChanged();
 }
 
 
-vector<Vector3f> PendulumSystem::evalF(vector<Vector3f> state)
+void PendulumSystem::evalF(const ParticleState &state, ParticleState &newState)
 {
-    vector<Vector3f> f;
+    // forces are accumulated in the velocity slots of the derivative.
     for (int i = 0; i < m_numParticles; ++i)
     {
-        // gravity
-        f.push_back(Vector3f(0, -particleMass * g, 0)); // positively down maaannn.
-        // drag
-        f.at(i) -= drag * getVelocity(i, state); // already a vector so we're good.
+        // gravity (positively down maaannn) and drag.
+        newState.setVelocity(i, Vector3f(0, -particleMass * g, 0) - drag * getVelocity(i, state));
     }
     // passing over springs and filling in the forces.
-    for (const auto &spring : springs)
+    addSpringForces(newState, SpringRange{0, (int)springs.size()}, state);
+    for (int i = 0; i < m_numParticles; ++i)
     {
-        Vector3f sf = springForce(spring, state);
-        f.at(spring.p0) += sf;
-        f.at(spring.p1) -= sf;
+        newState.setPosition(i, getVelocity(i, state));
+        newState.setVelocity(i, newState.getVelocity(i) / particleMass);
     }
-    vector<Vector3f> newState;
-    newState.push_back(Vector3f::ZERO); // first particle is stationary.
-    newState.push_back(Vector3f::ZERO);
+    // first particle is stationary, wherever reorderParticles put it.
+    newState.setPosition(particleIndex(0), Vector3f::ZERO);
+    newState.setVelocity(particleIndex(0), Vector3f::ZERO);
+}
 
-    for (int i = 1; i < m_numParticles; ++i)
-    {
-        newState.push_back(getVelocity(i, state));
-        newState.push_back(f.at(i) / particleMass);
-    }
-    return newState;
+void PendulumSystem::getConstrainedParticles(vector<int> &particles) const
+{
+    // first particle is stationary.
+    particles.assign(1, particleIndex(0));
 }
\ No newline at end of file
@@ -10,6 +10,7 @@ public:
 	 */
 	PendulumSystem(int numParticles);
 	void setupBasicSprings() override;
-	vector<Vector3f> evalF(vector<Vector3f> state) override;
+	void evalF(const ParticleState &state, ParticleState &f) override;
+	void getConstrainedParticles(vector<int> &particles) const override;
 };
 
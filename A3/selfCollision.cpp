@@ -0,0 +1,231 @@
+#include "selfCollision.h"
+#include <algorithm>
+#include <cmath>
+
+void SelfCollision::buildAdjacency(int numParticles, const std::vector<Spring> &springs)
+{
+    m_adjacencyStart.assign(numParticles + 1, 0);
+    for (const Spring &s : springs)
+    {
+        ++m_adjacencyStart[s.p0 + 1];
+        ++m_adjacencyStart[s.p1 + 1];
+    }
+    for (int i = 0; i < numParticles; ++i)
+        m_adjacencyStart[i + 1] += m_adjacencyStart[i];
+    m_adjacency.resize(m_adjacencyStart[numParticles]);
+    std::vector<int> next(m_adjacencyStart.begin(), m_adjacencyStart.end() - 1);
+    for (const Spring &s : springs)
+    {
+        m_adjacency[next[s.p0]++] = s.p1;
+        m_adjacency[next[s.p1]++] = s.p0;
+    }
+    m_adjacencyEnd.assign(m_adjacencyStart.begin() + 1, m_adjacencyStart.end());
+    m_numSprings = springs.size();
+}
+
+void SelfCollision::removeSpring(int p0, int p1)
+{
+    // nothing built yet, the next resolve builds from the springs without it.
+    if (m_adjacencyStart.empty())
+        return;
+    for (int k = 0; k < 2; ++k)
+    {
+        int i = k ? p1 : p0, j = k ? p0 : p1;
+        for (int a = m_adjacencyStart[i]; a < m_adjacencyEnd[i]; ++a)
+            if (m_adjacency[a] == j)
+            {
+                m_adjacency[a] = m_adjacency[--m_adjacencyEnd[i]];
+                break;
+            }
+    }
+    --m_numSprings;
+}
+
+bool SelfCollision::joined(int i, int j) const
+{
+    for (int a = m_adjacencyStart[i]; a < m_adjacencyEnd[i]; ++a)
+        if (m_adjacency[a] == j)
+            return true;
+    return false;
+}
+
+int SelfCollision::cellCoord(float x) const
+{
+    return (int)std::floor(x / thickness);
+}
+
+unsigned SelfCollision::cellHash(int cx, int cy, int cz) const
+{
+    return ((unsigned)cx * 73856093u ^ (unsigned)cy * 19349663u ^ (unsigned)cz * 83492791u) & m_tableMask;
+}
+
+void SelfCollision::buildHash(const ParticleState &state, ThreadPool *pool)
+{
+    const int n = state.size();
+    const unsigned tableSize = m_tableMask + 1;
+    const float *px = state.px(), *py = state.py(), *pz = state.pz();
+    std::fill(m_cellStart.begin(), m_cellStart.end(), 0);
+
+    // count particles per cell.
+    auto count = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            unsigned h = cellHash(cellCoord(px[i]), cellCoord(py[i]), cellCoord(pz[i]));
+            m_particleCell[i] = h;
+            __atomic_fetch_add(&m_cellStart[h + 1], 1, __ATOMIC_RELAXED);
+        }
+    };
+    // prefix sum, then scatter.
+    auto scatter = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            int slot = __atomic_fetch_add(&m_cellCursor[m_particleCell[i]], 1, __ATOMIC_RELAXED);
+            m_sorted[slot] = i;
+        }
+    };
+    // the scatter order inside a cell depends on the threads, sorting the
+    // (tiny) cells keeps the result deterministic.
+    auto sortCells = [&](int begin, int end)
+    {
+        for (int c = begin; c < end; ++c)
+            if (m_cellStart[c + 1] - m_cellStart[c] > 1)
+                std::sort(m_sorted.begin() + m_cellStart[c], m_sorted.begin() + m_cellStart[c + 1]);
+    };
+    if (pool)
+        pool->parallelFor(0, n, count);
+    else
+        count(0, n);
+    for (unsigned c = 0; c < tableSize; ++c)
+        m_cellStart[c + 1] += m_cellStart[c];
+    std::copy(m_cellStart.begin(), m_cellStart.end() - 1, m_cellCursor.begin());
+    if (pool)
+    {
+        pool->parallelFor(0, n, scatter);
+        pool->parallelFor(0, tableSize, sortCells, 4096);
+    }
+    else
+    {
+        scatter(0, n);
+        sortCells(0, tableSize);
+    }
+}
+
+void SelfCollision::resolve(ParticleState &state, const std::vector<Spring> &springs,
+                            const std::vector<int> &pinned, ThreadPool *pool)
+{
+    const int n = state.size();
+    if (m_adjacencyStart.size() != size_t(n + 1) || m_numSprings != springs.size())
+        buildAdjacency(n, springs);
+    if (m_particleCell.size() != size_t(n))
+    {
+        unsigned tableSize = 1;
+        while (tableSize < 2u * n)
+            tableSize *= 2;
+        m_tableMask = tableSize - 1;
+        m_particleCell.resize(n);
+        m_cellStart.resize(tableSize + 1);
+        m_cellCursor.resize(tableSize);
+        m_sorted.resize(n);
+        m_delta.resize(3 * n);
+        m_deltaV.resize(3 * n);
+        m_isPinned.resize(n);
+        m_contacts.resize(n);
+        m_pushed.resize(n);
+    }
+    std::fill(m_isPinned.begin(), m_isPinned.end(), 0);
+    for (int p : pinned)
+        m_isPinned[p] = 1;
+
+    buildHash(state, pool);
+
+    float *px = state.px(), *py = state.py(), *pz = state.pz();
+    float *vx = state.vx(), *vy = state.vy(), *vz = state.vz();
+    const float thicknessSquared = thickness * thickness;
+    auto gather = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            float dx = 0, dy = 0, dz = 0, dvx = 0, dvy = 0, dvz = 0;
+            int contacts = 0;
+            bool pushed = false;
+            int cx = cellCoord(px[i]), cy = cellCoord(py[i]), cz = cellCoord(pz[i]);
+            // different cells can hash to the same bucket, visit each bucket once.
+            unsigned visited[27];
+            int numVisited = 0;
+            for (int ox = -1; ox <= 1; ++ox)
+                for (int oy = -1; oy <= 1; ++oy)
+                    for (int oz = -1; oz <= 1; ++oz)
+                    {
+                        unsigned h = cellHash(cx + ox, cy + oy, cz + oz);
+                        if (std::find(visited, visited + numVisited, h) != visited + numVisited)
+                            continue;
+                        visited[numVisited++] = h;
+                        for (int s = m_cellStart[h]; s < m_cellStart[h + 1]; ++s)
+                        {
+                            int j = m_sorted[s];
+                            if (j == i)
+                                continue;
+                            float rx = px[i] - px[j], ry = py[i] - py[j], rz = pz[i] - pz[j];
+                            float distSquared = rx * rx + ry * ry + rz * rz;
+                            if (distSquared >= thicknessSquared || distSquared == 0 || joined(i, j))
+                                continue;
+                            float dist = std::sqrt(distSquared);
+                            float nx = rx / dist, ny = ry / dist, nz = rz / dist;
+                            // half the penetration each, all of it against a pinned particle.
+                            float share = m_isPinned[j] ? 1.f : 0.5f;
+                            float push = share * (thickness - dist);
+                            dx += push * nx;
+                            dy += push * ny;
+                            dz += push * nz;
+                            float approach = (vx[i] - vx[j]) * nx + (vy[i] - vy[j]) * ny + (vz[i] - vz[j]) * nz;
+                            if (approach < 0)
+                            {
+                                dvx -= share * approach * nx;
+                                dvy -= share * approach * ny;
+                                dvz -= share * approach * nz;
+                            }
+                            ++contacts;
+                            pushed |= !m_isPinned[j];
+                        }
+                    }
+            m_delta[i] = dx;
+            m_delta[n + i] = dy;
+            m_delta[2 * n + i] = dz;
+            m_deltaV[i] = dvx;
+            m_deltaV[n + i] = dvy;
+            m_deltaV[2 * n + i] = dvz;
+            m_contacts[i] = contacts;
+            m_pushed[i] = m_isPinned[i] && pushed;
+        }
+    };
+    // all corrections are gathered before any is applied (jacobi style).
+    auto apply = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            if (m_isPinned[i])
+                continue;
+            px[i] += m_delta[i];
+            py[i] += m_delta[n + i];
+            pz[i] += m_delta[2 * n + i];
+            vx[i] += m_deltaV[i];
+            vy[i] += m_deltaV[n + i];
+            vz[i] += m_deltaV[2 * n + i];
+        }
+    };
+    if (pool)
+    {
+        pool->parallelFor(0, n, gather, 256);
+        pool->parallelFor(0, n, apply);
+    }
+    else
+    {
+        gather(0, n);
+        apply(0, n);
+    }
+    m_lastContacts = 0;
+    for (int c : m_contacts)
+        m_lastContacts += c;
+}
@@ -0,0 +1,67 @@
+#ifndef SELFCOLLISION_H
+#define SELFCOLLISION_H
+
+#include <vector>
+
+#include "particleState.h"
+#include "Spring.h"
+#include "threadPool.h"
+
+/**
+ * @brief particle-particle self collision through a uniform spatial hash.
+ * the hash (cell size = thickness) is rebuilt every call with a counting sort,
+ * each particle then checks the 27 cells around it, so a call is O(n).
+ * pairs closer than thickness that aren't joined by a spring are pushed
+ * apart half way each, and their approaching normal velocity is removed.
+ * corrections are gathered per particle, so the particles can be split
+ * across threads without atomics.
+ */
+class SelfCollision
+{
+public:
+	float thickness = 0.5f;
+
+	/**
+	 * @brief resolves the contacts of state in place.
+	 * pinned particles push others but don't move themselves.
+	 */
+	void resolve(ParticleState &state, const std::vector<Spring> &springs,
+				 const std::vector<int> &pinned, ThreadPool *pool);
+	// contacts (counted once per particle in them) found by the last resolve.
+	int lastContacts() const { return m_lastContacts; }
+	// true if the last resolve found pinned particle i in contact with an unpinned one.
+	bool pushedAgainst(int i) const { return m_pushed[i]; }
+	// the springs were replaced, the next resolve rebuilds the adjacency.
+	void springsChanged() { m_adjacencyStart.clear(); }
+	// the spring between p0 and p1 was removed from the springs passed to resolve.
+	void removeSpring(int p0, int p1);
+
+private:
+	void buildAdjacency(int numParticles, const std::vector<Spring> &springs);
+	bool joined(int i, int j) const;
+	void buildHash(const ParticleState &state, ThreadPool *pool);
+	unsigned cellHash(int cx, int cy, int cz) const;
+	int cellCoord(float x) const;
+
+	// springs of every particle, csr. removeSpring shrinks a particle's
+	// list in place, so it ends at m_adjacencyEnd.
+	std::vector<int> m_adjacencyStart;
+	std::vector<int> m_adjacencyEnd;
+	std::vector<int> m_adjacency;
+	size_t m_numSprings = 0;
+
+	unsigned m_tableMask = 0;
+	std::vector<unsigned> m_particleCell;
+	std::vector<int> m_cellStart;  // table size + 1
+	std::vector<int> m_cellCursor;
+	std::vector<int> m_sorted;     // particles by cell
+
+	std::vector<float> m_delta;    // position corrections, 3 * n
+	std::vector<float> m_deltaV;   // velocity corrections, 3 * n
+	std::vector<char> m_isPinned;
+	std::vector<int> m_contacts;   // per particle
+	std::vector<char> m_pushed;    // per particle, see pushedAgainst
+	int m_lastContacts = 0;
+};
+
+#endif
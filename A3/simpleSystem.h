@@ -14,7 +14,7 @@ class SimpleSystem: public ParticleSystem
 public:
 	SimpleSystem();
 	
-	vector<Vector3f> evalF(vector<Vector3f> state);
+	void evalF(const ParticleState &state, ParticleState &f);
 	
 	void draw();
 	
@@ -0,0 +1,71 @@
+#include "simulationThread.h"
+#include <chrono>
+#include <iostream>
+
+SimulationThread::SimulationThread(ParticleSystem *system, TimeStepper *timeStepper,
+                                   float stepSize, float stepsPerSecond)
+    : m_system(system), m_timeStepper(timeStepper), m_stepSize(stepSize), m_stepsPerSecond(stepsPerSecond)
+{
+    Frame first;
+    first.state = system->getState();
+    m_frames.reset(first);
+    m_thread = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
+
+void SimulationThread::post(std::function<void()> command)
+{
+    std::lock_guard<std::mutex> lock(m_commandsMutex);
+    m_commands.push_back(std::move(command));
+}
+
+void SimulationThread::stop()
+{
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void SimulationThread::run()
+{
+    using clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1 / m_stepsPerSecond));
+    std::vector<std::function<void()>> commands;
+    auto next = clock::now();
+    long step = 0;
+    while (m_running)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_commandsMutex);
+            commands.swap(m_commands);
+        }
+        for (auto &command : commands)
+            command();
+        if (!commands.empty())
+            m_system->stateChanged();
+        commands.clear();
+
+        // a failed stepper leaves the last frame up, the commands still run.
+        if (!m_timeStepper->failed())
+        {
+            m_timeStepper->step(m_system, m_stepSize);
+            Frame &frame = m_frames.back();
+            frame.state = m_system->getState();
+            frame.step = ++step;
+            m_frames.publish();
+            if (m_timeStepper->failed())
+                std::cerr << "the time stepper failed after step " << step << ", stopped stepping." << std::endl;
+        }
+
+        next += period;
+        auto now = clock::now();
+        if (next < now) // fell behind, don't try to catch up.
+            next = now;
+        else
+            std::this_thread::sleep_until(next);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "particleSystem.h"
+#include "TimeStepper.hpp"
+#include "tripleBuffer.h"
+
+/**
+ * @brief steps a particle system on its own thread at a fixed rate, so the
+ * simulation speed doesn't depend on how fast the window draws.
+ * every finished step is published through a triple buffer, latest() hands
+ * the newest one to the render thread. anything that changes the system
+ * (toggles, parameters) goes through post() and runs on the simulation
+ * thread between two steps.
+ */
+class SimulationThread
+{
+public:
+	struct Frame
+	{
+		ParticleState state;
+		long step = 0;
+	};
+
+	/**
+	 * @param stepsPerSecond steps taken per second of wall clock time, if
+	 * a step takes longer the simulation just runs slower.
+	 */
+	SimulationThread(ParticleSystem *system, TimeStepper *timeStepper,
+					 float stepSize, float stepsPerSecond = 50);
+	// stops the thread.
+	~SimulationThread();
+	SimulationThread(const SimulationThread &) = delete;
+	SimulationThread &operator=(const SimulationThread &) = delete;
+
+	// runs command on the simulation thread before the next step,
+	// then marks the system's state changed (see stateGeneration).
+	void post(std::function<void()> command);
+	// render thread: newest published frame.
+	const Frame &latest() { return m_frames.front(); }
+	// waits for the current step to finish and joins the thread.
+	void stop();
+
+private:
+	void run();
+	ParticleSystem *m_system;
+	TimeStepper *m_timeStepper;
+	float m_stepSize;
+	float m_stepsPerSecond;
+	TripleBuffer<Frame> m_frames;
+	std::mutex m_commandsMutex;
+	std::vector<std::function<void()>> m_commands;
+	std::atomic<bool> m_running{true};
+	std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "sleepTiles.h"
+#include <algorithm>
+
+void SleepTiles::build(int tilesPerSide, const std::vector<int> &tileOfParticle)
+{
+    const int numTiles = tilesPerSide * tilesPerSide;
+    m_tilesPerSide = tilesPerSide;
+    m_tileOfParticle = tileOfParticle;
+    m_tileStart.assign(numTiles + 1, 0);
+    for (int t : tileOfParticle)
+        ++m_tileStart[t + 1];
+    for (int t = 0; t < numTiles; ++t)
+        m_tileStart[t + 1] += m_tileStart[t];
+    m_tileParticles.resize(tileOfParticle.size());
+    std::vector<int> next(m_tileStart.begin(), m_tileStart.end() - 1);
+    for (size_t p = 0; p < tileOfParticle.size(); ++p)
+        m_tileParticles[next[tileOfParticle[p]]++] = p;
+    m_asleep.assign(numTiles, 0);
+    m_moving.assign(numTiles, 0);
+    m_quietSteps.assign(numTiles, 0);
+    m_awakeMask.assign(tileOfParticle.size(), 1.f);
+    changed();
+}
+
+void SleepTiles::clear()
+{
+    m_tilesPerSide = 0;
+    m_tileOfParticle.clear();
+    m_tileStart.clear();
+    m_tileParticles.clear();
+    m_asleep.clear();
+    m_moving.clear();
+    m_quietSteps.clear();
+    m_awakeMask.clear();
+    changed();
+}
+
+void SleepTiles::update(ParticleState &state, const ParticleState &stepStart, float stepSize, ThreadPool *pool)
+{
+    const float *vx = state.vx(), *vy = state.vy(), *vz = state.vz();
+    const float *vx0 = stepStart.vx(), *vy0 = stepStart.vy(), *vz0 = stepStart.vz();
+    const float maxVelocity2 = velocity * velocity;
+    const float maxChange = acceleration * stepSize;
+    const float maxChange2 = maxChange * maxChange;
+    // every awake tile only writes its own entries.
+    auto scan = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            int t = m_awakeTiles[i];
+            bool quiet = true;
+            for (int s = m_tileStart[t]; s < m_tileStart[t + 1] && quiet; ++s)
+            {
+                int p = m_tileParticles[s];
+                float dx = vx[p] - vx0[p], dy = vy[p] - vy0[p], dz = vz[p] - vz0[p];
+                quiet = vx[p] * vx[p] + vy[p] * vy[p] + vz[p] * vz[p] < maxVelocity2 &&
+                        dx * dx + dy * dy + dz * dz < maxChange2;
+            }
+            m_moving[t] = !quiet;
+            m_quietSteps[t] = quiet ? m_quietSteps[t] + 1 : 0;
+        }
+    };
+    const int numAwake = m_awakeTiles.size();
+    if (pool)
+        pool->parallelFor(0, numAwake, scan, 64);
+    else
+        scan(0, numAwake);
+
+    bool anyChange = false;
+    // tiles next to moving ones stay (or get) awake.
+    for (int i = 0; i < numAwake; ++i)
+    {
+        int t = m_awakeTiles[i];
+        if (!m_moving[t])
+            continue;
+        int row = t / m_tilesPerSide, col = t % m_tilesPerSide;
+        for (int r = std::max(0, row - 1); r <= std::min(m_tilesPerSide - 1, row + 1); ++r)
+            for (int c = std::max(0, col - 1); c <= std::min(m_tilesPerSide - 1, col + 1); ++c)
+            {
+                int n = r * m_tilesPerSide + c;
+                if (n == t)
+                    continue;
+                m_quietSteps[n] = 0;
+                if (m_asleep[n])
+                {
+                    setAsleep(n, false);
+                    anyChange = true;
+                }
+            }
+    }
+    float *v[3] = {state.vx(), state.vy(), state.vz()};
+    for (int i = 0; i < numAwake; ++i)
+    {
+        int t = m_awakeTiles[i];
+        if (m_asleep[t] || m_quietSteps[t] < steps)
+            continue;
+        for (int s = m_tileStart[t]; s < m_tileStart[t + 1]; ++s)
+            for (int c = 0; c < 3; ++c)
+                v[c][m_tileParticles[s]] = 0;
+        setAsleep(t, true);
+        anyChange = true;
+    }
+    if (anyChange)
+        changed();
+}
+
+void SleepTiles::wake(int tile)
+{
+    m_quietSteps[tile] = 0;
+    if (!m_asleep[tile])
+        return;
+    setAsleep(tile, false);
+    changed();
+}
+
+void SleepTiles::wakeAll()
+{
+    std::fill(m_quietSteps.begin(), m_quietSteps.end(), 0);
+    if (numAsleep() == 0)
+        return;
+    for (size_t t = 0; t < m_asleep.size(); ++t)
+        if (m_asleep[t])
+            setAsleep(t, false);
+    changed();
+}
+
+void SleepTiles::addSleepingParticles(std::vector<int> &particles) const
+{
+    for (size_t t = 0; t < m_asleep.size(); ++t)
+        if (m_asleep[t])
+            particles.insert(particles.end(), m_tileParticles.begin() + m_tileStart[t],
+                             m_tileParticles.begin() + m_tileStart[t + 1]);
+}
+
+void SleepTiles::setAsleep(int tile, bool asleep)
+{
+    m_asleep[tile] = asleep;
+    for (int s = m_tileStart[tile]; s < m_tileStart[tile + 1]; ++s)
+        m_awakeMask[m_tileParticles[s]] = asleep ? 0.f : 1.f;
+}
+
+void SleepTiles::changed()
+{
+    m_awakeTiles.clear();
+    for (size_t t = 0; t < m_asleep.size(); ++t)
+        if (!m_asleep[t])
+            m_awakeTiles.push_back(t);
+    ++m_generation;
+}
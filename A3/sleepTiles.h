@@ -0,0 +1,68 @@
+#ifndef SLEEPTILES_H
+#define SLEEPTILES_H
+
+#include <vector>
+
+#include "particleState.h"
+#include "threadPool.h"
+
+/**
+ * @brief rest detection for a grid of particles split into square tiles.
+ * a tile falls asleep once all its particles stayed under the velocity and
+ * acceleration thresholds for steps steps in a row, its velocities are then
+ * set to 0 and the system is expected to hold its particles still and skip
+ * their forces (see awakeMask). a moving tile keeps its 8 neighbors awake
+ * and wakes the sleeping ones, everything else that wakes tiles (contacts,
+ * parameter changes) is up to the owner, through wake and wakeAll.
+ */
+class SleepTiles
+{
+public:
+	float velocity = 0.01f;
+	float acceleration = 0.05f;
+	int steps = 30;
+
+	// tilesPerSide x tilesPerSide tiles, particle p is in tileOfParticle[p]. all of them awake.
+	void build(int tilesPerSide, const std::vector<int> &tileOfParticle);
+	void clear();
+	bool empty() const { return m_asleep.empty(); }
+
+	/**
+	 * @brief counts the quiet steps of the awake tiles, the acceleration is the
+	 * change of the velocities since stepStart over stepSize. wakes the neighbors
+	 * of tiles that moved and puts the tiles to sleep that were quiet long enough.
+	 */
+	void update(ParticleState &state, const ParticleState &stepStart, float stepSize, ThreadPool *pool);
+	void wake(int tile);
+	void wakeAll();
+
+	int tilesPerSide() const { return m_tilesPerSide; }
+	int tileOf(int particle) const { return m_tileOfParticle[particle]; }
+	bool asleep(int tile) const { return m_asleep[tile]; }
+	int numAsleep() const { return m_asleep.size() - m_awakeTiles.size(); }
+	const std::vector<int> &awakeTiles() const { return m_awakeTiles; }
+	// 1 for particles of awake tiles, 0 for sleeping ones.
+	const std::vector<float> &awakeMask() const { return m_awakeMask; }
+	// appends the particles of the sleeping tiles.
+	void addSleepingParticles(std::vector<int> &particles) const;
+	// changes whenever a tile falls asleep or wakes up.
+	unsigned generation() const { return m_generation; }
+
+private:
+	void setAsleep(int tile, bool asleep);
+	void changed();
+
+	int m_tilesPerSide = 0;
+	std::vector<int> m_tileOfParticle;
+	// particles of every tile, csr.
+	std::vector<int> m_tileStart;
+	std::vector<int> m_tileParticles;
+	std::vector<char> m_asleep;
+	std::vector<char> m_moving;
+	std::vector<int> m_quietSteps;
+	std::vector<int> m_awakeTiles;
+	std::vector<float> m_awakeMask;
+	unsigned m_generation = 0;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "springJacobian.h"
+#include <algorithm>
+#include <cmath>
+
+void SpringJacobianAssembler::setPattern(const ParticleSpringSystem &system, int numParticles)
+{
+    const vector<Spring> &springs = system.getSprings();
+    vector<pair<int, int>> blocks;
+    blocks.reserve(2 * springs.size());
+    for (const Spring &s : springs)
+    {
+        blocks.push_back({s.p0, s.p1});
+        blocks.push_back({s.p1, s.p0});
+    }
+    dfdx.setPattern(numParticles, blocks);
+    dfdv.copyPattern(dfdx);
+
+    m_springsGeneration = system.springsGeneration();
+    m_springBlocks.resize(springs.size());
+    for (size_t i = 0; i < springs.size(); ++i)
+    {
+        const Spring &s = springs[i];
+        m_springBlocks[i] = {dfdx.diagonalBlock[s.p0], dfdx.findBlock(s.p0, s.p1),
+                             dfdx.findBlock(s.p1, s.p0), dfdx.diagonalBlock[s.p1]};
+    }
+}
+
+void SpringJacobianAssembler::assemble(const ParticleSpringSystem &system, const ParticleState &state,
+                                       bool clampCompressed)
+{
+    const vector<Spring> &springs = system.getSprings();
+    if (m_springsGeneration != system.springsGeneration() || dfdx.numRows() != state.size())
+        setPattern(system, state.size());
+
+    dfdv.setZero();
+    dfdv.addToDiagonal(-system.getDrag());
+
+    dfdx.setZero();
+    system.getActiveSpringRanges(m_ranges);
+    const float *px = state.px(), *py = state.py(), *pz = state.pz();
+    for (const SpringRange &sr : m_ranges)
+        for (int i = sr.start; i < sr.end; ++i)
+        {
+            const Spring &s = springs[i];
+            float d[3] = {px[s.p1] - px[s.p0], py[s.p1] - py[s.p0], pz[s.p1] - pz[s.p0]};
+            float len = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            if (len == 0)
+                continue;
+            for (float &c : d)
+                c /= len;
+            // df0/dx1 = Ks = k (c (I - dd^T) + dd^T), df0/dx0 = -Ks,
+            // df1/dx1 = -Ks, df1/dx0 = Ks.
+            float c = 1 - s.r / len;
+            if (clampCompressed)
+                c = max(0.f, c);
+            float ks[9];
+            for (int row = 0; row < 3; ++row)
+                for (int col = 0; col < 3; ++col)
+                    ks[3 * row + col] = s.k * ((1 - c) * d[row] * d[col] + (row == col ? c : 0));
+
+            const SpringBlocks &b = m_springBlocks[i];
+            float *b00 = dfdx.block(b.p0p0), *b01 = dfdx.block(b.p0p1);
+            float *b10 = dfdx.block(b.p1p0), *b11 = dfdx.block(b.p1p1);
+            for (int e = 0; e < 9; ++e)
+            {
+                b00[e] -= ks[e];
+                b01[e] += ks[e];
+                b10[e] += ks[e];
+                b11[e] -= ks[e];
+            }
+        }
+}
@@ -0,0 +1,46 @@
+#ifndef SPRINGJACOBIAN_H
+#define SPRINGJACOBIAN_H
+
+#include <vector>
+
+#include "blockSparseMatrix.h"
+#include "particleSpringSystem.h"
+
+/**
+ * @brief assembles the force jacobians df/dx and df/dv of a ParticleSpringSystem
+ * as 3x3 block sparse matrices.
+ * the pattern comes from all springs of the system and is only rebuilt when
+ * the particle count or the springsGeneration changes (another system has
+ * another springsGeneration too), each
+ * assemble just refills the values through slots remembered per spring.
+ */
+class SpringJacobianAssembler
+{
+public:
+	/**
+	 * @brief fills dfdx and dfdv for state, from the system's active springs.
+	 * with clampCompressed the (1 - r/|d|) term of compressed springs is
+	 * clamped to 0, which keeps -dfdx positive semi definite (what implicit
+	 * solvers want). without it dfdx is the exact jacobian.
+	 */
+	void assemble(const ParticleSpringSystem &system, const ParticleState &state,
+				  bool clampCompressed = false);
+
+	BlockSparseMatrix dfdx;
+	// drag only, springs are undamped. same pattern as dfdx so they combine.
+	BlockSparseMatrix dfdv;
+
+private:
+	void setPattern(const ParticleSpringSystem &system, int numParticles);
+	// block indices a spring writes to.
+	struct SpringBlocks
+	{
+		int p0p0, p0p1, p1p0, p1p1;
+	};
+	std::vector<SpringBlocks> m_springBlocks;
+	std::vector<SpringRange> m_ranges;
+	// the springsGeneration the pattern was built from, 0 is never one.
+	unsigned long long m_springsGeneration = 0;
+};
+
+#endif
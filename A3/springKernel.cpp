@@ -0,0 +1,219 @@
+#include "springKernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+void addSpringForcesScalar(const Spring *springs, int count,
+                           const float *px, const float *py, const float *pz,
+                           float *fx, float *fy, float *fz)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const Spring &s = springs[i];
+        float dx = px[s.p1] - px[s.p0];
+        float dy = py[s.p1] - py[s.p0];
+        float dz = pz[s.p1] - pz[s.p0];
+        float len = std::sqrt(dx * dx + dy * dy + dz * dz);
+        float scale = s.k * (len - s.r);
+        float sfx = scale * (dx / len);
+        float sfy = scale * (dy / len);
+        float sfz = scale * (dz / len);
+        fx[s.p0] += sfx;
+        fy[s.p0] += sfy;
+        fz[s.p0] += sfz;
+        fx[s.p1] -= sfx;
+        fy[s.p1] -= sfy;
+        fz[s.p1] -= sfz;
+    }
+}
+
+namespace
+{
+    // the columns [begin, end) of [colBegin, colEnd) in a row whose particles have
+    // the neighbor (dRow, dCol) in the grid, false if there are none.
+    bool neighborColumns(const GridSpring &n, int side, int row, int colBegin, int colEnd, int &begin, int &end)
+    {
+        if (row + n.dRow < 0 || row + n.dRow >= side)
+            return false;
+        begin = std::max(colBegin, -n.dCol);
+        end = std::min(colEnd, side - n.dCol);
+        return begin < end;
+    }
+
+    // the springs from particles [begin, end) to the ones offset after them.
+    void addRowSpringForces(float k, float r, int begin, int end, int offset,
+                            const float *px, const float *py, const float *pz,
+                            float *fx, float *fy, float *fz)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            float dx = px[i + offset] - px[i];
+            float dy = py[i + offset] - py[i];
+            float dz = pz[i + offset] - pz[i];
+            float len = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float scale = k * (len - r);
+            fx[i] += scale * (dx / len);
+            fy[i] += scale * (dy / len);
+            fz[i] += scale * (dz / len);
+        }
+    }
+}
+
+void addGridSpringForcesScalar(const GridSpring *stencil, int count, int side, int rowBegin, int rowEnd,
+                               int colBegin, int colEnd, const float *px, const float *py, const float *pz,
+                               float *fx, float *fy, float *fz)
+{
+    for (int row = rowBegin; row < rowEnd; ++row)
+        for (int s = 0; s < count; ++s)
+        {
+            int begin, end;
+            if (!neighborColumns(stencil[s], side, row, colBegin, colEnd, begin, end))
+                continue;
+            int first = row * side;
+            addRowSpringForces(stencil[s].k, stencil[s].r, first + begin, first + end,
+                               stencil[s].dRow * side + stencil[s].dCol, px, py, pz, fx, fy, fz);
+        }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+static_assert(sizeof(Spring) == 4 * sizeof(float) && offsetof(Spring, r) == 3 * sizeof(float),
+              "addSpringForcesAvx2 loads Springs as 4 packed words");
+
+__attribute__((target("avx2,fma"))) void addSpringForcesAvx2(const Spring *springs, int count,
+                                                              const float *px, const float *py, const float *pz,
+                                                              float *fx, float *fy, float *fz)
+{
+    // after the transpose below lane j holds spring order[j] of the batch.
+    static const int order[8] = {0, 2, 4, 6, 1, 3, 5, 7};
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalves = _mm256_set1_ps(1.5f);
+    alignas(32) float sfx[8], sfy[8], sfz[8];
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // a Spring is 4 words (p0, p1, k, r), so 8 of them are 4 plain loads.
+        // a 4x4 transpose in each 128 bit lane turns them into p0, p1, k, r
+        // vectors, which is cheaper than gathering the fields.
+        const float *words = reinterpret_cast<const float *>(springs + i);
+        __m256 s01 = _mm256_loadu_ps(words);
+        __m256 s23 = _mm256_loadu_ps(words + 8);
+        __m256 s45 = _mm256_loadu_ps(words + 16);
+        __m256 s67 = _mm256_loadu_ps(words + 24);
+        __m256 t0 = _mm256_unpacklo_ps(s01, s23);
+        __m256 t1 = _mm256_unpackhi_ps(s01, s23);
+        __m256 t2 = _mm256_unpacklo_ps(s45, s67);
+        __m256 t3 = _mm256_unpackhi_ps(s45, s67);
+        __m256i p0 = _mm256_castps_si256(_mm256_shuffle_ps(t0, t2, 0x44));
+        __m256i p1 = _mm256_castps_si256(_mm256_shuffle_ps(t0, t2, 0xEE));
+        __m256 k = _mm256_shuffle_ps(t1, t3, 0x44);
+        __m256 r = _mm256_shuffle_ps(t1, t3, 0xEE);
+
+        __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(px, p1, 4), _mm256_i32gather_ps(px, p0, 4));
+        __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(py, p1, 4), _mm256_i32gather_ps(py, p0, 4));
+        __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(pz, p1, 4), _mm256_i32gather_ps(pz, p0, 4));
+        __m256 len2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+
+        // 1/|d| from rsqrt (12 bits) and one Newton step (~23 bits).
+        __m256 inv = _mm256_rsqrt_ps(len2);
+        __m256 halfLen2Inv2 = _mm256_mul_ps(_mm256_mul_ps(half, len2), _mm256_mul_ps(inv, inv));
+        inv = _mm256_mul_ps(inv, _mm256_sub_ps(threeHalves, halfLen2Inv2));
+        __m256 len = _mm256_mul_ps(len2, inv);
+
+        // k(|d| - r) / |d|
+        __m256 scale = _mm256_mul_ps(_mm256_mul_ps(k, _mm256_sub_ps(len, r)), inv);
+        _mm256_store_ps(sfx, _mm256_mul_ps(scale, dx));
+        _mm256_store_ps(sfy, _mm256_mul_ps(scale, dy));
+        _mm256_store_ps(sfz, _mm256_mul_ps(scale, dz));
+
+        // no scatter in AVX2, and springs in a batch may share particles.
+        for (int j = 0; j < 8; ++j)
+        {
+            const Spring &s = springs[i + order[j]];
+            fx[s.p0] += sfx[j];
+            fy[s.p0] += sfy[j];
+            fz[s.p0] += sfz[j];
+            fx[s.p1] -= sfx[j];
+            fy[s.p1] -= sfy[j];
+            fz[s.p1] -= sfz[j];
+        }
+    }
+    addSpringForcesScalar(springs + i, count - i, px, py, pz, fx, fy, fz);
+}
+
+// no fma target, else gcc contracts the mul and add intrinsics.
+__attribute__((target("avx2"))) void addGridSpringForcesAvx2(const GridSpring *stencil, int count, int side,
+                                                             int rowBegin, int rowEnd, int colBegin, int colEnd,
+                                                             const float *px, const float *py, const float *pz,
+                                                             float *fx, float *fy, float *fz)
+{
+    for (int row = rowBegin; row < rowEnd; ++row)
+        for (int s = 0; s < count; ++s)
+        {
+            int begin, end;
+            if (!neighborColumns(stencil[s], side, row, colBegin, colEnd, begin, end))
+                continue;
+            const int offset = stencil[s].dRow * side + stencil[s].dCol;
+            const __m256 k = _mm256_set1_ps(stencil[s].k);
+            const __m256 r = _mm256_set1_ps(stencil[s].r);
+            int i = row * side + begin;
+            const int last = row * side + end;
+            // every lane rounds like addGridSpringForcesScalar.
+            for (; i + 8 <= last; i += 8)
+            {
+                __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(px + i + offset), _mm256_loadu_ps(px + i));
+                __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(py + i + offset), _mm256_loadu_ps(py + i));
+                __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(pz + i + offset), _mm256_loadu_ps(pz + i));
+                __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                                          _mm256_mul_ps(dz, dz)));
+                __m256 scale = _mm256_mul_ps(k, _mm256_sub_ps(len, r));
+                _mm256_storeu_ps(fx + i, _mm256_add_ps(_mm256_loadu_ps(fx + i), _mm256_mul_ps(scale, _mm256_div_ps(dx, len))));
+                _mm256_storeu_ps(fy + i, _mm256_add_ps(_mm256_loadu_ps(fy + i), _mm256_mul_ps(scale, _mm256_div_ps(dy, len))));
+                _mm256_storeu_ps(fz + i, _mm256_add_ps(_mm256_loadu_ps(fz + i), _mm256_mul_ps(scale, _mm256_div_ps(dz, len))));
+            }
+            addRowSpringForces(stencil[s].k, stencil[s].r, i, last, offset, px, py, pz, fx, fy, fz);
+        }
+}
+
+bool cpuHasAvx2()
+{
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#else
+
+void addSpringForcesAvx2(const Spring *springs, int count,
+                         const float *px, const float *py, const float *pz,
+                         float *fx, float *fy, float *fz)
+{
+    addSpringForcesScalar(springs, count, px, py, pz, fx, fy, fz);
+}
+
+void addGridSpringForcesAvx2(const GridSpring *stencil, int count, int side, int rowBegin, int rowEnd,
+                             int colBegin, int colEnd, const float *px, const float *py, const float *pz,
+                             float *fx, float *fy, float *fz)
+{
+    addGridSpringForcesScalar(stencil, count, side, rowBegin, rowEnd, colBegin, colEnd, px, py, pz, fx, fy, fz);
+}
+
+bool cpuHasAvx2()
+{
+    return false;
+}
+
+#endif
+
+SpringForceKernel bestSpringForceKernel()
+{
+    return cpuHasAvx2() ? addSpringForcesAvx2 : addSpringForcesScalar;
+}
+
+GridSpringKernel bestGridSpringKernel()
+{
+    return cpuHasAvx2() ? addGridSpringForcesAvx2 : addGridSpringForcesScalar;
+}
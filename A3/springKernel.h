@@ -0,0 +1,74 @@
+#ifndef SPRINGKERNEL_H
+#define SPRINGKERNEL_H
+
+#include "Spring.h"
+
+/**
+ * @brief adds the forces of count springs to the force arrays:
+ * k(|d| - r) d/|d|, with d = x[p1] - x[p0], goes on p0 and its negative on p1.
+ * springs may share particles, the scatter is done one spring at a time.
+ */
+typedef void (*SpringForceKernel)(const Spring *springs, int count,
+								  const float *px, const float *py, const float *pz,
+								  float *fx, float *fy, float *fz);
+
+// one spring at a time, same arithmetic as ParticleSpringSystem::springForce
+// (with a single sqrt).
+void addSpringForcesScalar(const Spring *springs, int count,
+						   const float *px, const float *py, const float *pz,
+						   float *fx, float *fy, float *fz);
+
+/**
+ * @brief 8 springs per iteration with AVX2 gathers, |d| from one rsqrt plus
+ * a Newton step. per spring the result stays within
+ * 1e-6 * k * |d| (absolute, per component) of addSpringForcesScalar.
+ * only call it if cpuHasAvx2().
+ */
+void addSpringForcesAvx2(const Spring *springs, int count,
+						 const float *px, const float *py, const float *pz,
+						 float *fx, float *fy, float *fz);
+
+/**
+ * @brief one neighbor of the stencil of a regular grid, whose particle at
+ * row r, column c is r * side + c. every particle with a neighbor at
+ * (r + dRow, c + dCol) has a spring of stiffness k and rest length r to it.
+ */
+struct GridSpring
+{
+	int dRow, dCol;
+	float k, r;
+};
+
+/**
+ * @brief gather form of the spring forces of a regular grid: adds to every
+ * particle of the rows [rowBegin, rowEnd) and columns [colBegin, colEnd)
+ * k(|d| - r) d/|d|, d = x[neighbor] - x[particle],
+ * for each of the count stencil neighbors it has. no spring array and no
+ * index gathers, every load is contiguous along a row. a spring is computed
+ * at both of its ends, so disjoint blocks can run on different threads.
+ */
+typedef void (*GridSpringKernel)(const GridSpring *stencil, int count, int side,
+								 int rowBegin, int rowEnd, int colBegin, int colEnd,
+								 const float *px, const float *py, const float *pz,
+								 float *fx, float *fy, float *fz);
+
+void addGridSpringForcesScalar(const GridSpring *stencil, int count, int side,
+							   int rowBegin, int rowEnd, int colBegin, int colEnd,
+							   const float *px, const float *py, const float *pz,
+							   float *fx, float *fy, float *fz);
+
+// 8 particles of a row per iteration, same arithmetic (and results) as
+// addGridSpringForcesScalar. only call it if cpuHasAvx2().
+void addGridSpringForcesAvx2(const GridSpring *stencil, int count, int side,
+							 int rowBegin, int rowEnd, int colBegin, int colEnd,
+							 const float *px, const float *py, const float *pz,
+							 float *fx, float *fy, float *fz);
+
+// true if this cpu runs AVX2 and FMA.
+bool cpuHasAvx2();
+
+// the fastest kernel this cpu supports.
+SpringForceKernel bestSpringForceKernel();
+GridSpringKernel bestGridSpringKernel();
+
+#endif
@@ -0,0 +1,134 @@
+#include "sweep.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ensemble.h"
+
+using namespace std;
+
+namespace
+{
+    // "1,2.5,4" -> {1, 2.5, 4}, empty if any of them isn't a number.
+    vector<float> parseList(const string &list)
+    {
+        vector<float> values;
+        stringstream ss(list);
+        string value;
+        while (getline(ss, value, ','))
+        {
+            char *end;
+            values.push_back(strtof(value.c_str(), &end));
+            if (value.empty() || *end != 0)
+                return vector<float>();
+        }
+        return values;
+    }
+
+    bool allPositive(const vector<float> &values)
+    {
+        for (float value : values)
+            if (!(value > 0))
+                return false;
+        return true;
+    }
+
+    void printUsage(const char *program)
+    {
+        cerr << "usage: " << program << " sweep <size> <stepper> <duration> [k=a,b,..] [drag=..] [mass=..] [h=..]" << endl;
+    }
+}
+
+int runSweep(int argc, char *argv[])
+{
+    if (argc < 5)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    EnsembleOptions options;
+    char *sizeEnd, *durationEnd;
+    options.numParticlesPerSide = strtol(argv[2], &sizeEnd, 10);
+    options.stepper = argv[3];
+    options.duration = strtof(argv[4], &durationEnd);
+    if (*sizeEnd != 0 || options.numParticlesPerSide <= 0 || *durationEnd != 0 || !(options.duration > 0))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    EnsembleParameters defaults;
+    vector<float> ks = {defaults.k}, drags = {defaults.drag};
+    vector<float> masses = {defaults.particleMass}, stepSizes = {defaults.stepSize};
+    for (int i = 5; i < argc; ++i)
+    {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string name = arg.substr(0, eq);
+        vector<float> values = eq == string::npos ? vector<float>() : parseList(arg.substr(eq + 1));
+        if (values.empty())
+        {
+            cerr << "expected name=numbers, got " << arg << endl;
+            return 1;
+        }
+        if ((name == "mass" || name == "h") && !allPositive(values))
+        {
+            cerr << name << " has to be positive, got " << arg << endl;
+            return 1;
+        }
+        if (name == "k")
+            ks = values;
+        else if (name == "drag")
+            drags = values;
+        else if (name == "mass")
+            masses = values;
+        else if (name == "h")
+            stepSizes = values;
+        else
+        {
+            cerr << "unknown parameter " << name << ", can sweep k, drag, mass and h." << endl;
+            return 1;
+        }
+    }
+
+    vector<EnsembleParameters> grid;
+    for (float k : ks)
+        for (float drag : drags)
+            for (float mass : masses)
+                for (float h : stepSizes)
+                    grid.push_back(EnsembleParameters{k, drag, mass, h});
+
+    ThreadPool &pool = ThreadPool::shared();
+    vector<EnsembleResult> results;
+    try
+    {
+        results = runEnsemble(grid, options, pool);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    cout << grid.size() << " runs on " << pool.numThreads() << " threads" << endl;
+    printf("%8s %8s %8s %8s  %-16s %10s  %-16s %8s\n", "k", "drag", "mass", "h", "status", "settle", "hash", "seconds");
+    for (const EnsembleResult &r : results)
+    {
+        char status[32];
+        if (r.failTime < 0)
+            snprintf(status, sizeof(status), "%s", r.status.c_str());
+        else
+            snprintf(status, sizeof(status), "%s@%g", r.status.c_str(), r.failTime);
+        char settle[16] = "-";
+        if (r.settleTime >= 0)
+            snprintf(settle, sizeof(settle), "%g", r.settleTime);
+        printf("%8g %8g %8g %8g  %-16s %10s  %016llx %8.3f\n", r.parameters.k, r.parameters.drag,
+               r.parameters.particleMass, r.parameters.stepSize, status, settle,
+               (unsigned long long)r.stateHash, r.seconds);
+    }
+    return 0;
+}
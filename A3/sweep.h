@@ -0,0 +1,15 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+/**
+ * @brief runs a grid of cloth parameter sets on all cores, see runEnsemble.
+ * usage: a3 sweep <size> <stepper> <duration> [k=a,b,..] [drag=..] [mass=..] [h=..]
+ * every combination of the listed values is one run of a size x size cloth
+ * for duration simulated seconds, unlisted parameters keep their defaults.
+ * prints one line per run: its parameters, stable / nan / energy (with the
+ * time it failed at), settle time, final state hash and wall time.
+ * returns the process exit code.
+ */
+int runSweep(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,120 @@
+// Checks that evalF and takeStep don't touch the heap once warmed up.
+// build and run with "make check", exits with 1 if anything allocated.
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+
+#include "../ClothSystem.h"
+#include "../pendulumSystem.h"
+#include "../TimeStepper.hpp"
+
+using namespace std;
+
+// counting allocator, same as the benchmark's.
+namespace
+{
+    long g_numAllocs = 0;
+}
+
+void *operator new(size_t n)
+{
+    ++g_numAllocs;
+    if (void *p = malloc(n ? n : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void *operator new(size_t n, align_val_t alignment)
+{
+    ++g_numAllocs;
+    size_t a = size_t(alignment);
+    if (void *p = aligned_alloc(a, (n + a - 1) / a * a))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { free(p); }
+
+namespace
+{
+    const float kStepSize = 0.01f;
+    const int kWarmUpCalls = 3;
+    const int kCheckedCalls = 20;
+    int g_numFailures = 0;
+
+    // calls f kWarmUpCalls times, then fails if any of kCheckedCalls more allocates.
+    void check(const char *system, const char *what, const function<void()> &f)
+    {
+        for (int i = 0; i < kWarmUpCalls; ++i)
+            f();
+        long before = g_numAllocs;
+        for (int i = 0; i < kCheckedCalls; ++i)
+            f();
+        long allocs = g_numAllocs - before;
+        printf("%-24s %-16s %s", system, what, allocs ? "FAILED" : "ok");
+        if (allocs)
+        {
+            printf(", %ld allocations in %d calls", allocs, kCheckedCalls);
+            ++g_numFailures;
+        }
+        printf("\n");
+    }
+
+    void checkSystem(const char *name, const function<ParticleSystem *()> &create, bool isCloth)
+    {
+        {
+            unique_ptr<ParticleSystem> system(create());
+            ParticleState f(system->m_numParticles);
+            check(name, "evalF", [&]()
+                  { system->evalF(system->getState(), f); });
+        }
+        const char *steppers[] = {"e", "t", "m", "r", "rc", "38", "i", "d", "s", "v", "p"};
+        for (const char *type : steppers)
+        {
+            // position based dynamics only steps cloths.
+            if (!isCloth && string(type) == "p")
+                continue;
+            unique_ptr<ParticleSystem> system(create());
+            unique_ptr<TimeStepper> stepper(createTimeStepper(type, true));
+            string what = string("takeStep ") + type;
+            check(name, what.c_str(), [&]()
+                  { stepper->takeStep(system.get(), kStepSize); });
+        }
+    }
+}
+
+int main()
+{
+    checkSystem("pendulum", []()
+                { return new PendulumSystem(8); }, false);
+    checkSystem("cloth", []()
+                { return new ClothSystem(16); }, true);
+    checkSystem("cloth, springs", []()
+                {
+                    ClothSystem *cloth = new ClothSystem(16);
+                    cloth->useGridStencil = false;
+                    return cloth; }, true);
+    checkSystem("cloth, reordered", []()
+                {
+                    ClothSystem *cloth = new ClothSystem(16);
+                    cloth->reorderParticlesMorton();
+                    return cloth; }, true);
+    checkSystem("cloth, serial", []()
+                {
+                    ClothSystem *cloth = new ClothSystem(16);
+                    cloth->threadPool = nullptr;
+                    return cloth; }, true);
+    if (g_numFailures)
+    {
+        printf("%d checks allocated after warming up\n", g_numFailures);
+        return 1;
+    }
+    printf("no allocations after warming up\n");
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "threadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int numThreads)
+{
+    if (numThreads <= 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < numThreads; ++i)
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto &worker : m_workers)
+        worker.join();
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::run(int begin, int end, int grain, void *ctx, ChunkFn fn)
+{
+    std::lock_guard<std::mutex> runLock(m_runMutex);
+    // about 4 chunks per thread so uneven chunks even out.
+    int chunksWanted = 4 * numThreads();
+    int chunkSize = std::max(grain, (end - begin + chunksWanted - 1) / chunksWanted);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ctx = ctx;
+        m_fn = fn;
+        m_end = end;
+        m_chunkSize = chunkSize;
+        m_next.store(begin);
+        m_numBusy = m_workers.size();
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    workOnChunks();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]()
+                { return m_numBusy == 0; });
+}
+
+void ThreadPool::workerLoop()
+{
+    unsigned seenGeneration = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]()
+                        { return m_quit || m_generation != seenGeneration; });
+            if (m_quit)
+                return;
+            seenGeneration = m_generation;
+        }
+        workOnChunks();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_numBusy == 0)
+            m_done.notify_one();
+    }
+}
+
+void ThreadPool::workOnChunks()
+{
+    for (;;)
+    {
+        int begin = m_next.fetch_add(m_chunkSize);
+        if (begin >= m_end)
+            return;
+        m_fn(m_ctx, begin, std::min(begin + m_chunkSize, m_end));
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief fixed set of worker threads for data parallel loops.
+ * parallelFor splits [begin, end) into chunks, the calling thread works on
+ * chunks too and returns once all of them are done. a pool runs one loop at
+ * a time, so calling parallelFor from inside a body deadlocks.
+ */
+class ThreadPool
+{
+public:
+	/**
+	 * @param numThreads threads working on a loop, counting the caller.
+	 * 0 picks std::thread::hardware_concurrency().
+	 */
+	ThreadPool(int numThreads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	int numThreads() const { return m_workers.size() + 1; }
+
+	// process wide pool with one thread per core.
+	static ThreadPool &shared();
+
+	/**
+	 * @brief calls body(chunkBegin, chunkEnd) over disjoint chunks covering [begin, end).
+	 * ranges of at most grain items run inline on the calling thread.
+	 * doesn't allocate.
+	 */
+	template <typename F>
+	void parallelFor(int begin, int end, F &&body, int grain = 512)
+	{
+		if (m_workers.empty() || end - begin <= grain)
+		{
+			if (begin < end)
+				body(begin, end);
+			return;
+		}
+		typedef typename std::remove_reference<F>::type Body;
+		run(begin, end, grain, const_cast<void *>(static_cast<const void *>(&body)),
+			[](void *ctx, int b, int e)
+			{ (*static_cast<Body *>(ctx))(b, e); });
+	}
+
+private:
+	typedef void (*ChunkFn)(void *ctx, int begin, int end);
+	void run(int begin, int end, int grain, void *ctx, ChunkFn fn);
+	void workerLoop();
+	void workOnChunks();
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_runMutex; // one loop at a time
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	bool m_quit = false;
+	unsigned m_generation = 0;
+	int m_numBusy = 0;
+
+	// the loop currently running.
+	void *m_ctx = nullptr;
+	ChunkFn m_fn = nullptr;
+	int m_end = 0;
+	int m_chunkSize = 0;
+	std::atomic<int> m_next{0};
+};
+
+#endif
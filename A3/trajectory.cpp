@@ -0,0 +1,228 @@
+#include "trajectory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    const char kMagic[4] = {'A', '3', 'T', 'R'};
+    const uint32_t kVersion = 1;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        int32_t numParticles;
+        int32_t everyN;
+        float stepSize;
+        float quantum;
+    };
+
+    int64_t quantize(float x, float quantum)
+    {
+        if (!std::isfinite(x))
+            return 0;
+        double q = std::nearbyint(double(x) / quantum);
+        // clamped so extreme positions can't overflow the deltas.
+        const double limit = double(int64_t(1) << 52);
+        return int64_t(std::max(-limit, std::min(limit, q)));
+    }
+
+    void putVarint(std::vector<uint8_t> &out, int64_t value)
+    {
+        uint64_t zigzag = (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+        while (zigzag >= 0x80)
+        {
+            out.push_back(uint8_t(zigzag) | 0x80);
+            zigzag >>= 7;
+        }
+        out.push_back(uint8_t(zigzag));
+    }
+
+    const uint8_t *getVarint(const uint8_t *in, const uint8_t *end, int64_t &value)
+    {
+        uint64_t zigzag = 0;
+        for (int shift = 0; in < end && shift < 64; shift += 7)
+        {
+            uint8_t byte = *in++;
+            zigzag |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                value = int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+                return in;
+            }
+        }
+        return nullptr;
+    }
+}
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string &fileName, int numParticles, int everyN,
+                                       float stepSize, float quantum)
+    : m_out(fileName, std::ios::binary | std::ios::trunc), m_numParticles(numParticles),
+      m_everyN(everyN < 1 ? 1 : everyN), m_quantum(quantum), m_previous(3 * numParticles, 0)
+{
+    if (!m_out)
+        throw std::runtime_error("can't open " + fileName);
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.numParticles = numParticles;
+    header.everyN = m_everyN;
+    header.stepSize = stepSize;
+    header.quantum = quantum;
+    m_out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_bytesWritten = sizeof(header);
+    m_thread = std::thread(&TrajectoryRecorder::run, this);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    finish();
+}
+
+void TrajectoryRecorder::finish()
+{
+    if (!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_ready.notify_one();
+    m_thread.join();
+    m_out.flush();
+}
+
+void TrajectoryRecorder::record(const ParticleState &state)
+{
+    long call = m_calls++;
+    if (call % m_everyN != 0)
+        return;
+    Frame frame;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free.empty())
+        {
+            frame = std::move(m_free.back());
+            m_free.pop_back();
+        }
+    }
+    // the copy happens outside the lock, the writer never waits on it.
+    const int n = m_numParticles;
+    frame.step = call;
+    frame.positions.resize(3 * n);
+    std::memcpy(frame.positions.data(), state.px(), n * sizeof(float));
+    std::memcpy(frame.positions.data() + n, state.py(), n * sizeof(float));
+    std::memcpy(frame.positions.data() + 2 * n, state.pz(), n * sizeof(float));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(frame));
+    }
+    m_ready.notify_one();
+}
+
+void TrajectoryRecorder::run()
+{
+    std::vector<Frame> frames;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_ready.wait(lock, [&]
+                         { return !m_queue.empty() || m_closing; });
+            if (m_queue.empty())
+                break;
+            frames.swap(m_queue);
+        }
+        for (const Frame &frame : frames)
+            encode(frame);
+        m_out.flush();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Frame &frame : frames)
+            m_free.push_back(std::move(frame));
+        frames.clear();
+    }
+}
+
+void TrajectoryRecorder::encode(const Frame &frame)
+{
+    m_payload.clear();
+    for (size_t i = 0; i < m_previous.size(); ++i)
+    {
+        int64_t q = quantize(frame.positions[i], m_quantum);
+        putVarint(m_payload, q - m_previous[i]);
+        m_previous[i] = q;
+    }
+    uint32_t bytes = m_payload.size();
+    int64_t step = frame.step;
+    m_out.write(reinterpret_cast<const char *>(&bytes), sizeof(bytes));
+    m_out.write(reinterpret_cast<const char *>(&step), sizeof(step));
+    m_out.write(reinterpret_cast<const char *>(m_payload.data()), bytes);
+    m_bytesWritten += sizeof(bytes) + sizeof(step) + bytes;
+    ++m_framesWritten;
+}
+
+TrajectoryReader::TrajectoryReader(const std::string &fileName)
+    : m_in(fileName, std::ios::binary), m_fileName(fileName)
+{
+    if (!m_in)
+        throw std::runtime_error("can't open " + fileName);
+    Header header;
+    if (!m_in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.numParticles < 0)
+        throw std::runtime_error(fileName + " is not a trajectory");
+    if (header.version != kVersion)
+        throw std::runtime_error(fileName + " has unsupported version " + std::to_string(header.version));
+    // the recorder never writes these, replay timing and positions come from them.
+    if (!(header.quantum > 0) || header.everyN < 1 || !(header.stepSize > 0))
+        throw std::runtime_error(fileName + " is not a trajectory");
+    m_numParticles = header.numParticles;
+    m_everyN = header.everyN;
+    m_stepSize = header.stepSize;
+    m_quantum = header.quantum;
+    m_firstFrame = m_in.tellg();
+    m_previous.assign(3 * m_numParticles, 0);
+}
+
+bool TrajectoryReader::next(ParticleState &state, long *step)
+{
+    uint32_t bytes;
+    int64_t frameStep;
+    if (!m_in.read(reinterpret_cast<char *>(&bytes), sizeof(bytes)) ||
+        !m_in.read(reinterpret_cast<char *>(&frameStep), sizeof(frameStep)))
+        return false;
+    m_payload.resize(bytes);
+    if (!m_in.read(reinterpret_cast<char *>(m_payload.data()), bytes))
+        return false; // cut off while recording.
+
+    if (state.size() != m_numParticles)
+        state.resize(m_numParticles);
+    const int n = m_numParticles;
+    float *position[3] = {state.px(), state.py(), state.pz()};
+    const uint8_t *in = m_payload.data(), *end = in + bytes;
+    int64_t *previous = m_previous.data();
+    for (int c = 0; c < 3; ++c)
+        for (int i = 0; i < n; ++i, ++previous)
+        {
+            int64_t delta;
+            in = getVarint(in, end, delta);
+            if (!in)
+                throw std::runtime_error(m_fileName + " has a corrupt frame");
+            *previous += delta;
+            position[c][i] = float(double(*previous) * m_quantum);
+        }
+    std::fill(state.vx(), state.vx() + n, 0.f);
+    std::fill(state.vy(), state.vy() + n, 0.f);
+    std::fill(state.vz(), state.vz() + n, 0.f);
+    if (step)
+        *step = frameStep;
+    return true;
+}
+
+void TrajectoryReader::rewind()
+{
+    m_in.clear();
+    m_in.seekg(m_firstFrame);
+    std::fill(m_previous.begin(), m_previous.end(), 0);
+}
@@ -0,0 +1,113 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "particleState.h"
+
+/**
+ * trajectory files hold the particle positions of every Nth step.
+ * positions are quantized to multiples of quantum (1e-4 by default) and each
+ * frame stores the difference to the previous frame's quantized positions,
+ * zigzag and varint coded: a particle that moved less than ~0.006 in a
+ * coordinate costs one byte for it. the quantized values are exact, so
+ * errors don't add up over the frames. non finite positions are stored as 0.
+ *
+ * layout: header (magic "A3TR", version, particle count, N, step size,
+ * quantum), then per frame the payload size (uint32), the step (int64) and
+ * the x deltas of all particles, then the y and the z deltas.
+ */
+
+/**
+ * @brief streams states to a trajectory file. record() copies the
+ * positions and returns, a background thread encodes and writes them.
+ * frames queue up in memory if the disk can't keep up.
+ */
+class TrajectoryRecorder
+{
+public:
+	// throws runtime_error if fileName can't be opened.
+	TrajectoryRecorder(const std::string &fileName, int numParticles, int everyN = 1,
+					   float stepSize = 0, float quantum = 1e-4f);
+	// finish()es.
+	~TrajectoryRecorder();
+	TrajectoryRecorder(const TrajectoryRecorder &) = delete;
+	TrajectoryRecorder &operator=(const TrajectoryRecorder &) = delete;
+
+	// call with the initial state and after every step, keeps every Nth one.
+	void record(const ParticleState &state);
+	// writes the queued frames and stops the writer, record() mustn't be called after.
+	void finish();
+	// frames written to the file so far.
+	long framesWritten() const { return m_framesWritten; }
+	long bytesWritten() const { return m_bytesWritten; }
+
+private:
+	struct Frame
+	{
+		int64_t step;
+		std::vector<float> positions; // x..., y..., z...
+	};
+	void run();
+	void encode(const Frame &frame);
+
+	std::ofstream m_out;
+	int m_numParticles;
+	int m_everyN;
+	float m_quantum;
+	long m_calls = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_ready;
+	std::vector<Frame> m_queue;
+	std::vector<Frame> m_free; // recycled buffers
+	bool m_closing = false;
+
+	// writer thread only.
+	std::vector<int64_t> m_previous;
+	std::vector<uint8_t> m_payload;
+	std::atomic<long> m_framesWritten{0};
+	std::atomic<long> m_bytesWritten{0};
+	std::thread m_thread;
+};
+
+/**
+ * @brief plays a trajectory file back frame by frame.
+ */
+class TrajectoryReader
+{
+public:
+	// throws runtime_error if fileName isn't a trajectory.
+	TrajectoryReader(const std::string &fileName);
+
+	int numParticles() const { return m_numParticles; }
+	int everyN() const { return m_everyN; }
+	float stepSize() const { return m_stepSize; }
+	/**
+	 * @brief decodes the next frame into the positions of state (resized to
+	 * numParticles(), velocities zero). returns false after the last frame.
+	 */
+	bool next(ParticleState &state, long *step = nullptr);
+	// back to the first frame.
+	void rewind();
+
+private:
+	std::ifstream m_in;
+	std::string m_fileName;
+	int m_numParticles;
+	int m_everyN;
+	float m_stepSize;
+	float m_quantum;
+	std::streampos m_firstFrame;
+	std::vector<int64_t> m_previous;
+	std::vector<uint8_t> m_payload;
+};
+
+#endif
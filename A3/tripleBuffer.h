@@ -0,0 +1,53 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+/**
+ * @brief hands the newest of a stream of values from one writer thread to
+ * one reader thread without locks. the writer fills back() and publishes it,
+ * the reader takes whatever was published last; neither ever waits and
+ * values published in between are skipped. each side owns one slot, the
+ * third one is swapped between them through an atomic index.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+	// fills every slot with value, before the threads start.
+	void reset(const T &value)
+	{
+		for (T &slot : m_slots)
+			slot = value;
+		m_middle.store(2, std::memory_order_relaxed);
+		m_back = 0;
+		m_front = 1;
+	}
+
+	// writer side: the slot to fill next.
+	T &back() { return m_slots[m_back]; }
+	// writer side: makes back() the newest value and hands out a new back().
+	void publish()
+	{
+		m_back = m_middle.exchange(m_back | kFresh, std::memory_order_acq_rel) & kIndex;
+	}
+
+	// reader side: the newest published value, stays valid until the next call.
+	const T &front()
+	{
+		if (m_middle.load(std::memory_order_relaxed) & kFresh)
+			m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & kIndex;
+		return m_slots[m_front];
+	}
+
+private:
+	static const int kIndex = 3;
+	// set while the middle slot holds a value the reader hasn't taken yet.
+	static const int kFresh = 4;
+	T m_slots[3];
+	int m_back = 0;
+	int m_front = 1;
+	std::atomic<int> m_middle{2};
+};
+
+#endif